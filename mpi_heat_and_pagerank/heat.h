@@ -0,0 +1,93 @@
+// Header file for the mpi_heat programs
+
+#ifndef HEAT_H
+#define HEAT_H
+
+#include <stdio.h>
+#include <mpi.h>
+
+// Binary result files start with a fixed size header followed by the
+// temperatures as raw doubles in row major order: nsteps rows of
+// dims[0]*dims[1]*dims[2] cells each. Files are written in the native
+// byte order of the machine that produced them.
+#define HEAT_MAGIC "HEATBIN"
+#define HEAT_VERSION 1
+#define HEAT_HEADER_SIZE 128          // bytes reserved at the start of the file
+
+// Rows are aligned to and padded out to this many bytes so the stencil
+// loops start on a cache line and vector loads stay aligned
+#define HEAT_ALIGN 64
+#define HEAT_ALIGN_DOUBLES (HEAT_ALIGN/(int)sizeof(double))
+
+// Default cells per tile when advancing several time steps at once.
+// Two rows of this many doubles fit comfortably in L2.
+#define HEAT_TILE 4096
+
+typedef struct {
+  char magic[8];                      // HEAT_MAGIC, null terminated
+  int version;                        // HEAT_VERSION
+  int ndims;                          // 1 for a rod, 2 for a plate, 3 for a block
+  int dims[3];                        // cells in x, y, z, unused dims are 1
+  int nsteps;                         // number of time steps (rows) stored
+  int first_step;                     // time step of the first stored row
+  int reserved;
+  double initial_temp;                // Initial temp of internal cells
+  double L_bound_temp;                // Constant temp at Left end of rod
+  double R_bound_temp;                // Constant temp at Right end of rod
+  double k;                           // thermal conductivity constant
+} heat_header_t;
+
+// heat_funcs.c
+#pragma omp declare simd
+double calc_next(double posleft, double pos, double posright);
+#pragma omp declare simd
+double calc_next5(double pos, double left, double right, double up, double down);
+#pragma omp declare simd
+double calc_next7(double pos, double left, double right, double up, double down,
+                  double front, double back);
+int heat_partition(int n, int nparts, int part, int *start);
+void heat_exchange_halo(double *row, int nloc, int depth, int left, int right, MPI_Comm comm);
+void heat_advance_block(double **rows, int nsteps, int lo, int hi,
+                        int lo_clamp, int hi_clamp, int tile);
+
+// heat_implicit.c
+typedef struct heat_cn heat_cn_t;
+heat_cn_t *heat_cn_setup(double r, int nloc, int gstart, int width, MPI_Comm comm);
+void heat_cn_step(heat_cn_t *cn, double *next, double *cur,
+                  double L_bound_temp, double R_bound_temp);
+void heat_cn_free(heat_cn_t *cn);
+
+// heat_mg.c
+int heat_mg_steady(double *row, int nloc, int gstart, int width, double tol,
+                   int max_cycles, MPI_Comm comm, double *resid);
+
+// heat_stats.c
+typedef struct heat_stats heat_stats_t;
+heat_stats_t *heat_stats_open(MPI_Comm comm, char *fname, int nonblocking,
+                              double k, double threshold);
+void heat_stats_step(heat_stats_t *st, int step, const double *row,
+                     int nloc, int gstart, int width);
+void heat_stats_close(heat_stats_t *st);
+
+// heat_io.c
+void heat_header_init(heat_header_t *hdr, int ndims, int *dims, int nsteps, int first_step,
+                      double initial_temp, double L_bound_temp, double R_bound_temp, double k);
+int heat_header_check(heat_header_t *hdr, char *fname);
+MPI_File heat_open_output(MPI_Comm comm, char *fname, heat_header_t *hdr);
+void heat_write_grid(MPI_File fh, double *data, int ndims, int *asizes, int *lsizes,
+                     int *astarts, int *gsizes, int *gstarts);
+void heat_write_rod(MPI_File fh, double *data, int nrows, int row_stride,
+                    int nloc, int gstart, int width);
+MPI_File heat_open_input(MPI_Comm comm, char *fname, heat_header_t *hdr);
+void heat_read_grid(MPI_File fh, double *data, int ndims, int *asizes, int *lsizes,
+                    int *astarts, int *gsizes, int *gstarts);
+void heat_read_rod_row(MPI_File fh, heat_header_t *hdr, int step, double *row,
+                       int nloc, int gstart);
+void heat_write_checkpoint(MPI_Comm comm, char *fname, heat_header_t *hdr,
+                           double *row, int nloc, int gstart);
+void heat_print_table_header(FILE *out, int width);
+void heat_print_grid_header(FILE *out, int ndims, int z, int step, int width);
+void heat_print_ensemble_header(FILE *out, int step, int width);
+void heat_print_table_row(FILE *out, int t, double *row, int width);
+
+#endif
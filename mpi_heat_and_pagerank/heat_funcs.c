@@ -0,0 +1,123 @@
+// Stencil and communication routines for the mpi_heat programs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+#include <omp.h>
+#include <heat.h>
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+#pragma omp declare simd
+double calc_next(double posleft, double pos, double posright){
+  double left_diff, right_diff, delta;
+  double k = 0.5; //thermal conductivity constant
+  left_diff = pos - posleft;
+  right_diff = pos - posright;
+  delta = -k*(left_diff + right_diff);
+  return (pos + delta);
+}
+
+// calc_next for a 5 point stencil on a plate. Each of the four
+// neighbours pulls on the cell, k is halved so the explicit scheme sits
+// at the same stability limit as the rod.
+#pragma omp declare simd
+double calc_next5(double pos, double left, double right, double up, double down){
+  double delta;
+  double k = 0.5/2; //thermal conductivity constant
+  delta = -k*((pos - left) + (pos - right) + (pos - up) + (pos - down));
+  return (pos + delta);
+}
+
+// calc_next for a 7 point stencil on a block
+#pragma omp declare simd
+double calc_next7(double pos, double left, double right, double up, double down,
+                  double front, double back){
+  double delta;
+  double k = 0.5/3; //thermal conductivity constant
+  delta = -k*((pos - left) + (pos - right) + (pos - up) + (pos - down)
+              + (pos - front) + (pos - back));
+  return (pos + delta);
+}
+
+// Split n cells into nparts nearly equal pieces, the first n%nparts
+// pieces get one extra cell. Returns the size of piece part and sets
+// start to its first cell.
+int heat_partition(int n, int nparts, int part, int *start){
+  int base = n/nparts;
+  int extra = n%nparts;
+  *start = part*base + (part < extra ? part : extra);
+  return base + (part < extra ? 1 : 0);
+}
+
+// Swap depth ghost cells with the left and right neighbours. row
+// points at the first owned cell; row[-depth..-1] and
+// row[nloc..nloc+depth-1] are the ghost cells. A neighbour of
+// MPI_PROC_NULL leaves that side untouched.
+void heat_exchange_halo(double *row, int nloc, int depth, int left, int right, MPI_Comm comm){
+  MPI_Sendrecv(&row[nloc-depth], depth, MPI_DOUBLE, right, 1,
+               &row[-depth],     depth, MPI_DOUBLE, left,  1,
+               comm, MPI_STATUS_IGNORE);
+  MPI_Sendrecv(&row[0],          depth, MPI_DOUBLE, left,  2,
+               &row[nloc],       depth, MPI_DOUBLE, right, 2,
+               comm, MPI_STATUS_IGNORE);
+}
+
+// Apply the stencil to cells [from,to) of next using cur. The rows
+// never overlap so the loop vectorizes with calc_next inlined.
+static void advance_range(double *restrict next, const double *restrict cur, int from, int to){
+  int p;
+#pragma omp simd
+  for(p=from; p<to; p++){
+    next[p] = calc_next(cur[p-1], cur[p], cur[p+1]);
+  }
+}
+
+// Advance rows[0] by nsteps time steps, filling rows[1..nsteps].
+// Step s computes rows[s+1] over [max(lo+s,lo_clamp), min(hi-s,hi_clamp)),
+// so the region shrinks by a cell on each side per step as the ghost
+// cells go stale, but stops at the clamps which sit next to fixed
+// boundary cells. rows[0] must be valid one cell past the region.
+//
+// The region is cut into upright trapezoids about tile cells wide which
+// are each run through all nsteps before moving on, then the
+// inverted trapezoids left between them are filled in. That keeps a
+// tile's working set in cache across steps, and works when rows[s] and
+// rows[s+2] share storage since no tile reads a cell another has
+// overwritten. The upright trapezoids are shared out between the
+// threads, then the inverted ones, so the only hand off between
+// threads is the barrier between the two phases.
+void heat_advance_block(double **rows, int nsteps, int lo, int hi,
+                        int lo_clamp, int hi_clamp, int tile){
+  int ntiles, j, s, a, b, from, to;
+  if(tile < 2*nsteps){ //narrower tiles would have their trapezoids overlap
+    tile = 2*nsteps;
+  }
+  if((hi-lo)/tile < omp_get_max_threads()){//give every thread a tile if there is room
+    tile = MAX((hi-lo)/omp_get_max_threads(), 2*nsteps);
+  }
+  ntiles = MAX((hi-lo)/tile, 1);
+#pragma omp parallel private(j,s,a,b,from,to) if(ntiles > 1)
+  {
+#pragma omp for schedule(static)
+    for(j=0; j<ntiles; j++){//upright trapezoids
+      a = lo + j*tile;
+      b = (j == ntiles-1) ? hi : a+tile;
+      for(s=0; s<nsteps; s++){
+        from = MAX((j == 0) ? lo+s : a+s, lo_clamp);
+        to = MIN((j == ntiles-1) ? hi-s : b-s, hi_clamp);
+        advance_range(rows[s+1], rows[s], from, to);
+      }
+    }
+#pragma omp for schedule(static)
+    for(j=1; j<ntiles; j++){//inverted trapezoids between them
+      b = lo + j*tile;
+      for(s=1; s<nsteps; s++){
+        from = MAX(MAX(b-s, lo+s), lo_clamp);
+        to = MIN(MIN(b+s, hi-s), hi_clamp);
+        advance_range(rows[s+1], rows[s], from, to);
+      }
+    }
+  }
+}
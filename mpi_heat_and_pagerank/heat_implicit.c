@@ -0,0 +1,207 @@
+// Crank-Nicolson time stepping for the rod. Each step solves the
+// tridiagonal system
+//
+//   -r/2 u[i-1] + (1+r) u[i] - r/2 u[i+1] = rhs[i]
+//
+// spread across the processors with the SPIKE algorithm: every
+// processor solves its own block, the blocks are tied together by a
+// small system in the first and last unknown of each block, and each
+// processor then corrects its block using its neighbours' values.
+// The matrix never changes so everything but the right hand side is
+// factored once up front.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+#include <heat.h>
+
+struct heat_cn {
+  MPI_Comm comm;
+  int npes, proc_id;
+  double r;                     // conductivity times time step over cell size squared
+  int first;                    // local index of the first unknown
+  int m;                        // unknowns on this processor
+  int own_left, own_right;      // this processor holds the fixed end of the rod
+  double *cp;                   // Thomas algorithm: scaled super diagonal
+  double *den;                  // Thomas algorithm: reciprocal pivots
+  double *v, *w;                // left and right spikes
+  double *y;                    // scratch for the local solve
+  double *band;                 // LU of the reduced system, 5 diagonals per row
+  double *rhs;                  // right hand side and solution of the reduced system
+};
+
+// Solve the local block T x = d in place
+static void local_solve(heat_cn_t *cn, double *d){
+  double a = -cn->r/2;
+  int i;
+  d[0] *= cn->den[0];
+  for(i=1; i<cn->m; i++){
+    d[i] = (d[i] - a*d[i-1]) * cn->den[i];
+  }
+  for(i=cn->m-2; i>=0; i--){
+    d[i] -= cn->cp[i]*d[i+1];
+  }
+}
+
+// Entry (i,j) of the banded reduced system, |i-j| <= 2
+#define BAND(cn,i,j) ((cn)->band[(i)*5 + (j)-(i)+2])
+
+// Factor the reduced system. Row 2i says what the first unknown of
+// processor i is in terms of the last unknown of processor i-1 and the
+// first of processor i+1; row 2i+1 does the same for its last unknown.
+// The spikes are below one in size so no pivoting is needed.
+static void reduced_factor(heat_cn_t *cn, double *spikes){
+  int n = 2*cn->npes;
+  int i,j,k;
+  for(i=0; i<n*5; i++){
+    cn->band[i] = 0.0;
+  }
+  for(i=0; i<cn->npes; i++){
+    double *s = &spikes[4*i];   // v first, v last, w first, w last
+    BAND(cn,2*i,2*i) = 1.0;
+    BAND(cn,2*i+1,2*i+1) = 1.0;
+    if(i > 0){
+      BAND(cn,2*i,2*i-1) = s[0];
+      BAND(cn,2*i+1,2*i-1) = s[1];
+    }
+    if(i < cn->npes-1){
+      BAND(cn,2*i,2*i+2) = s[2];
+      BAND(cn,2*i+1,2*i+2) = s[3];
+    }
+  }
+  for(k=0; k<n; k++){
+    for(i=k+1; i<n && i<=k+2; i++){
+      double l = BAND(cn,i,k) / BAND(cn,k,k);
+      BAND(cn,i,k) = l;
+      for(j=k+1; j<n && j<=k+2; j++){
+        BAND(cn,i,j) -= l*BAND(cn,k,j);
+      }
+    }
+  }
+}
+
+// Solve the factored reduced system for cn->rhs in place
+static void reduced_solve(heat_cn_t *cn){
+  int n = 2*cn->npes;
+  int i,j;
+  double *b = cn->rhs;
+  for(i=0; i<n; i++){
+    for(j=(i >= 2 ? i-2 : 0); j<i; j++){
+      b[i] -= BAND(cn,i,j)*b[j];
+    }
+  }
+  for(i=n-1; i>=0; i--){
+    for(j=i+1; j<n && j<=i+2; j++){
+      b[i] -= BAND(cn,i,j)*b[j];
+    }
+    b[i] /= BAND(cn,i,i);
+  }
+}
+
+// Set up Crank-Nicolson steps of size r for a processor owning nloc
+// cells starting at gstart of a rod width cells long. Every processor
+// in comm needs at least one cell that is not a fixed end; returns NULL
+// on all of them if that is not the case.
+heat_cn_t *heat_cn_setup(double r, int nloc, int gstart, int width, MPI_Comm comm){
+  heat_cn_t *cn = malloc(sizeof(heat_cn_t));
+  double a = -r/2, b = 1+r, c = -r/2;
+  double spike[4] = {0.0, 0.0, 0.0, 0.0};
+  double *spikes;
+  int i, fewest;
+
+  cn->comm = comm;
+  MPI_Comm_size(comm, &cn->npes);
+  MPI_Comm_rank(comm, &cn->proc_id);
+  cn->r = r;
+  cn->own_left = (gstart == 0);
+  cn->own_right = (gstart+nloc == width);
+  cn->first = cn->own_left ? 1 : 0;
+  cn->m = nloc - cn->first - (cn->own_right ? 1 : 0);
+  MPI_Allreduce(&cn->m, &fewest, 1, MPI_INT, MPI_MIN, comm);
+  if(fewest < 1){
+    free(cn);
+    return NULL;
+  }
+
+  cn->cp = malloc(cn->m * sizeof(double));
+  cn->den = malloc(cn->m * sizeof(double));
+  cn->v = malloc(cn->m * sizeof(double));
+  cn->w = malloc(cn->m * sizeof(double));
+  cn->y = malloc(cn->m * sizeof(double));
+  cn->band = malloc(2*cn->npes*5 * sizeof(double));
+  cn->rhs = malloc(2*cn->npes * sizeof(double));
+  spikes = malloc(4*cn->npes * sizeof(double));
+
+  cn->den[0] = 1.0/b;
+  cn->cp[0] = c*cn->den[0];
+  for(i=1; i<cn->m; i++){
+    cn->den[i] = 1.0/(b - a*cn->cp[i-1]);
+    cn->cp[i] = c*cn->den[i];
+  }
+  // The spikes are the local block's response to its neighbours'
+  // couplings. The fixed ends are not unknowns so the outermost
+  // processors only have one spike.
+  for(i=0; i<cn->m; i++){
+    cn->v[i] = cn->w[i] = 0.0;
+  }
+  if(!cn->own_left){
+    cn->v[0] = a;
+    local_solve(cn, cn->v);
+  }
+  if(!cn->own_right){
+    cn->w[cn->m-1] = c;
+    local_solve(cn, cn->w);
+  }
+  spike[0] = cn->v[0];
+  spike[1] = cn->v[cn->m-1];
+  spike[2] = cn->w[0];
+  spike[3] = cn->w[cn->m-1];
+  MPI_Allgather(spike, 4, MPI_DOUBLE, spikes, 4, MPI_DOUBLE, comm);
+  reduced_factor(cn, spikes);
+  free(spikes);
+  return cn;
+}
+
+// Take one step from cur to next. cur must hold one valid ghost cell
+// on each side and the fixed ends; L_bound_temp and R_bound_temp are
+// the end temperatures at the new time.
+void heat_cn_step(heat_cn_t *cn, double *next, double *cur,
+                  double L_bound_temp, double R_bound_temp){
+  double half = cn->r/2;
+  double mine[2], xl, xr;
+  int i,p;
+
+  for(i=0; i<cn->m; i++){//explicit half of the step
+    p = cn->first + i;
+    cn->y[i] = (1-cn->r)*cur[p] + half*(cur[p-1] + cur[p+1]);
+  }
+  if(cn->own_left){//fixed ends move to the right hand side
+    cn->y[0] += half*L_bound_temp;
+  }
+  if(cn->own_right){
+    cn->y[cn->m-1] += half*R_bound_temp;
+  }
+  local_solve(cn, cn->y);
+
+  mine[0] = cn->y[0];
+  mine[1] = cn->y[cn->m-1];
+  MPI_Allgather(mine, 2, MPI_DOUBLE, cn->rhs, 2, MPI_DOUBLE, cn->comm);
+  reduced_solve(cn);
+  xl = (cn->proc_id > 0) ? cn->rhs[2*cn->proc_id-1] : 0.0;
+  xr = (cn->proc_id < cn->npes-1) ? cn->rhs[2*cn->proc_id+2] : 0.0;
+
+  for(i=0; i<cn->m; i++){
+    next[cn->first + i] = cn->y[i] - cn->v[i]*xl - cn->w[i]*xr;
+  }
+}
+
+void heat_cn_free(heat_cn_t *cn){
+  free(cn->cp);
+  free(cn->den);
+  free(cn->v);
+  free(cn->w);
+  free(cn->y);
+  free(cn->band);
+  free(cn->rhs);
+  free(cn);
+}
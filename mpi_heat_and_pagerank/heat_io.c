@@ -0,0 +1,235 @@
+// Binary and text output for the mpi_heat programs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include <heat.h>
+
+// Fill in a header describing nsteps rows of a grid with the given
+// dimensions. Dimensions past ndims are set to 1.
+void heat_header_init(heat_header_t *hdr, int ndims, int *dims, int nsteps, int first_step,
+                      double initial_temp, double L_bound_temp, double R_bound_temp, double k){
+  int d;
+  memset(hdr, 0, sizeof(heat_header_t));
+  strcpy(hdr->magic, HEAT_MAGIC);
+  hdr->version = HEAT_VERSION;
+  hdr->ndims = ndims;
+  for(d=0; d<3; d++){
+    hdr->dims[d] = (d < ndims) ? dims[d] : 1;
+  }
+  hdr->nsteps = nsteps;
+  hdr->first_step = first_step;
+  hdr->initial_temp = initial_temp;
+  hdr->L_bound_temp = L_bound_temp;
+  hdr->R_bound_temp = R_bound_temp;
+  hdr->k = k;
+}
+
+// Check that a header read from fname looks like one we wrote. Prints
+// a message and returns 0 if it does not.
+int heat_header_check(heat_header_t *hdr, char *fname){
+  if(strncmp(hdr->magic, HEAT_MAGIC, sizeof(hdr->magic)) != 0){
+    fprintf(stderr,"ERROR: %s is not a heat result file\n",fname);
+    return 0;
+  }
+  if(hdr->version != HEAT_VERSION){
+    fprintf(stderr,"ERROR: %s has version %d, expected %d\n",fname,hdr->version,HEAT_VERSION);
+    return 0;
+  }
+  return 1;
+}
+
+// Collectively create fname and have the root write the header. Every
+// processor in comm gets back the open file for the data writes.
+MPI_File heat_open_output(MPI_Comm comm, char *fname, heat_header_t *hdr){
+  MPI_File fh;
+  int proc_id, err;
+  MPI_Comm_rank(comm, &proc_id);
+  err = MPI_File_open(comm, fname, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                      MPI_INFO_NULL, &fh);
+  if(err != MPI_SUCCESS){
+    if(proc_id == 0){
+      fprintf(stderr,"ERROR: could not open %s for writing\n",fname);
+    }
+    MPI_Abort(comm, 1);
+  }
+  MPI_File_set_size(fh, 0);     // drop anything left over from an older, longer file
+  if(proc_id == 0){
+    char buf[HEAT_HEADER_SIZE];
+    memset(buf, 0, HEAT_HEADER_SIZE);
+    memcpy(buf, hdr, sizeof(heat_header_t));
+    MPI_File_write_at(fh, 0, buf, HEAT_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+  }
+  return fh;
+}
+
+// Collectively write this processor's block of a grid. The block is
+// lsizes cells starting at astarts within the local array of asizes
+// cells (which includes any ghost cells), and lands at gstarts within
+// the global grid of gsizes cells stored after the header. Sizes are
+// in C order, slowest dimension first.
+void heat_write_grid(MPI_File fh, double *data, int ndims, int *asizes, int *lsizes,
+                     int *astarts, int *gsizes, int *gstarts){
+  MPI_Datatype filetype, memtype;
+
+  MPI_Type_create_subarray(ndims, gsizes, lsizes, gstarts, MPI_ORDER_C, MPI_DOUBLE, &filetype);
+  MPI_Type_create_subarray(ndims, asizes, lsizes, astarts, MPI_ORDER_C, MPI_DOUBLE, &memtype);
+  MPI_Type_commit(&filetype);
+  MPI_Type_commit(&memtype);
+
+  MPI_File_set_view(fh, HEAT_HEADER_SIZE, MPI_DOUBLE, filetype, "native", MPI_INFO_NULL);
+  MPI_File_write_at_all(fh, 0, data, 1, memtype, MPI_STATUS_IGNORE);
+
+  MPI_Type_free(&filetype);
+  MPI_Type_free(&memtype);
+}
+
+// Collectively write nrows time steps of this processor's slice of the
+// rod. Row t of the slice starts at data[t*row_stride] and has nloc
+// cells which land at columns gstart..gstart+nloc-1 of a file row that
+// is width cells wide. All rows go out in a single write_at_all.
+void heat_write_rod(MPI_File fh, double *data, int nrows, int row_stride,
+                    int nloc, int gstart, int width){
+  int gsizes[2] = {nrows, width};
+  int asizes[2] = {nrows, row_stride};
+  int lsizes[2] = {nrows, nloc};
+  int astarts[2] = {0, 0};
+  int gstarts[2] = {0, gstart};
+  heat_write_grid(fh, data, 2, asizes, lsizes, astarts, gsizes, gstarts);
+}
+
+// Collectively open fname for reading and read its header into hdr.
+// Aborts if the file cannot be opened or was not written by us.
+MPI_File heat_open_input(MPI_Comm comm, char *fname, heat_header_t *hdr){
+  MPI_File fh;
+  char buf[HEAT_HEADER_SIZE];
+  int proc_id, err, ok = 1;
+  MPI_Comm_rank(comm, &proc_id);
+  err = MPI_File_open(comm, fname, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+  if(err != MPI_SUCCESS){
+    if(proc_id == 0){
+      fprintf(stderr,"ERROR: could not open %s for reading\n",fname);
+    }
+    MPI_Abort(comm, 1);
+  }
+  MPI_File_read_at_all(fh, 0, buf, HEAT_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+  memcpy(hdr, buf, sizeof(heat_header_t));
+  if(proc_id == 0){//everyone read the same header, only the root complains
+    ok = heat_header_check(hdr, fname);
+  }
+  MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+  if(!ok){
+    MPI_Abort(comm, 1);
+  }
+  return fh;
+}
+
+// Collectively read this processor's block of a grid, the reverse of
+// heat_write_grid
+void heat_read_grid(MPI_File fh, double *data, int ndims, int *asizes, int *lsizes,
+                    int *astarts, int *gsizes, int *gstarts){
+  MPI_Datatype filetype, memtype;
+
+  MPI_Type_create_subarray(ndims, gsizes, lsizes, gstarts, MPI_ORDER_C, MPI_DOUBLE, &filetype);
+  MPI_Type_create_subarray(ndims, asizes, lsizes, astarts, MPI_ORDER_C, MPI_DOUBLE, &memtype);
+  MPI_Type_commit(&filetype);
+  MPI_Type_commit(&memtype);
+
+  MPI_File_set_view(fh, HEAT_HEADER_SIZE, MPI_DOUBLE, filetype, "native", MPI_INFO_NULL);
+  MPI_File_read_at_all(fh, 0, data, 1, memtype, MPI_STATUS_IGNORE);
+
+  MPI_Type_free(&filetype);
+  MPI_Type_free(&memtype);
+}
+
+// Collectively read columns gstart..gstart+nloc-1 of row step of a rod
+// file described by hdr into row. Any processor count can read any
+// file since each picks out its own columns.
+void heat_read_rod_row(MPI_File fh, heat_header_t *hdr, int step, double *row,
+                       int nloc, int gstart){
+  int gsizes[2] = {hdr->nsteps, hdr->dims[0]};
+  int asizes[2] = {1, nloc};
+  int lsizes[2] = {1, nloc};
+  int astarts[2] = {0, 0};
+  int gstarts[2] = {step, gstart};
+  heat_read_grid(fh, row, 2, asizes, lsizes, astarts, gsizes, gstarts);
+}
+
+// Save one row of the rod as a one row result file. The row goes to
+// fname.tmp first which the root then renames over fname, so a run
+// killed part way through a checkpoint still leaves the last one
+// intact.
+void heat_write_checkpoint(MPI_Comm comm, char *fname, heat_header_t *hdr,
+                           double *row, int nloc, int gstart){
+  MPI_File fh;
+  char *tmp = malloc(strlen(fname) + 5);
+  int proc_id;
+  MPI_Comm_rank(comm, &proc_id);
+  sprintf(tmp, "%s.tmp", fname);
+  fh = heat_open_output(comm, tmp, hdr);
+  heat_write_rod(fh, row, 1, nloc, nloc, gstart, hdr->dims[0]);
+  MPI_File_close(&fh);
+  MPI_Barrier(comm);            // every write is done before the file takes the old one's place
+  if(proc_id == 0 && rename(tmp, fname) != 0){
+    fprintf(stderr,"ERROR: could not rename %s to %s\n",tmp,fname);
+  }
+  free(tmp);
+}
+
+// Column numbers and the rule under them
+static void print_columns(FILE *out, int width){
+  int p;
+  fprintf(out,"%3s| ","");
+  for(p=0; p<width; p++){
+    fprintf(out,"%5d ",p);
+  }
+  fprintf(out,"\n");
+  fprintf(out,"%3s+-","---");
+  for(p=0; p<width; p++){
+    fprintf(out,"------");
+  }
+  fprintf(out,"\n");
+}
+
+// Print the banner and column headers of the rod temperature table
+void heat_print_table_header(FILE *out, int width){
+  fprintf(out,"Temperature results for 1D rod\n");
+  fprintf(out,"Time step increases going down rows\n");
+  fprintf(out,"Position on rod changes going accross columns\n");
+  // Column headers
+  print_columns(out, width);
+}
+
+// Print the banner and column headers for one plane of a 2D plate or
+// 3D block. Rows of the table are y, columns are x.
+void heat_print_grid_header(FILE *out, int ndims, int z, int step, int width){
+  if(ndims == 2){
+    fprintf(out,"Temperature results for 2D plate at time step %d\n",step);
+  }
+  else{
+    fprintf(out,"Temperature results for 3D block at time step %d, slice z = %d\n",step,z);
+  }
+  fprintf(out,"Y position increases going down rows\n");
+  fprintf(out,"X position changes going accross columns\n");
+  print_columns(out, width);
+}
+
+// Print the banner and column headers of the table of final rod
+// temperatures for an ensemble, one row per member
+void heat_print_ensemble_header(FILE *out, int step, int width){
+  fprintf(out,"Temperature results for an ensemble of 1D rods at time step %d\n",step);
+  fprintf(out,"Ensemble member increases going down rows\n");
+  fprintf(out,"Position on rod changes going accross columns\n");
+  print_columns(out, width);
+}
+
+// Print one time step of the rod temperature table
+void heat_print_table_row(FILE *out, int t, double *row, int width){
+  int p;
+  fprintf(out,"%3d| ",t);
+  for(p=0; p<width; p++){
+    fprintf(out,"%5.1f ",row[p]);
+  }
+  fprintf(out,"\n");
+}
@@ -0,0 +1,287 @@
+// Geometric multigrid for the steady state of the rod: the profile u
+// with u[i-1] - 2u[i] + u[i+1] = 0 between the fixed ends. Each V-cycle
+// smooths with weighted Jacobi, moves the residual to a grid with every
+// other point, corrects from there and smooths again. Every level is
+// split across the processors the same way as the rod so smoothing,
+// restriction and interpolation only need one ghost cell from each
+// neighbour. The coarsest level is gathered to the root and solved
+// directly.
+//
+// The coarse points are every other fine point plus the right end, so
+// an odd number of intervals leaves the last coarse interval short.
+// Each level has one spacing H with a last interval of its own length,
+// and the stencils, full weighting and interpolation weigh the points
+// by their distances. Coarsening stops when a processor would be left
+// with fewer than two points, so the coarsest level has about two
+// points per processor; if it still has more than MG_COARSE_MAX the
+// solve gives up rather than gather a big grid to the root.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <mpi.h>
+#include <heat.h>
+
+#define MG_MAX_LEVELS 32
+#define MG_SWEEPS 2             // Jacobi sweeps before and after each coarse correction
+#define MG_OMEGA (2.0/3.0)      // Jacobi damping
+#define MG_COARSE_MAX 4096      // most points solved directly on the root
+
+// Arrays have one ghost cell on each side: index 1 is the first owned
+// point and index nloc is the last.
+typedef struct {
+  int n;                        // points on this level, ends included
+  int nloc;                     // points owned by this processor
+  int gstart;                   // global index of the first owned point
+  double H;                     // grid spacing
+  double hl;                    // length of the last interval, H or shorter
+  double *u;                    // solution, or correction on coarse levels
+  double *f;                    // right hand side
+  double *r;                    // residual
+} level_t;
+
+typedef struct {
+  MPI_Comm comm;
+  int proc_id, npes;
+  int left, right;
+  int nlev;
+  level_t lev[MG_MAX_LEVELS];
+  int *counts, *displs;         // coarsest level layout, for the direct solve
+  double *U, *F;                // coarsest level on the root
+} mg_t;
+
+// Global index of local point j of a level
+#define GLOBAL(l,j) ((l)->gstart + (j) - 1)
+// Interior points are everything but the fixed ends
+#define INTERIOR(l,j) (GLOBAL(l,j) > 0 && GLOBAL(l,j) < (l)->n-1)
+// Interval to the right of interior point g, the one to its left is H
+#define RIGHT(l,g) ((g) == (l)->n-2 ? (l)->hl : (l)->H)
+
+static void residual(mg_t *mg, level_t *l){
+  double hm = l->H, hp;
+  int j;
+  heat_exchange_halo(&l->u[1], l->nloc, 1, mg->left, mg->right, mg->comm);
+  for(j=1; j<=l->nloc; j++){
+    if(INTERIOR(l,j)){
+      hp = RIGHT(l, GLOBAL(l,j));
+      l->r[j] = l->f[j] - 2/(hm+hp) * ((l->u[j+1] - l->u[j])/hp - (l->u[j] - l->u[j-1])/hm);
+    }
+    else{
+      l->r[j] = 0.0;
+    }
+  }
+}
+
+static void smooth(mg_t *mg, level_t *l, int sweeps){
+  int j,k;
+  for(k=0; k<sweeps; k++){
+    residual(mg, l);
+    for(j=1; j<=l->nloc; j++){//divide by the diagonal, -2/(hm*hp)
+      l->u[j] -= MG_OMEGA * l->H*RIGHT(l, GLOBAL(l,j))/2 * l->r[j];
+    }
+  }
+}
+
+// Full weighting of the fine residual onto the coarse right hand side:
+// each fine point's residual, times the length around it, shared out
+// with the interpolation weights and divided by the length around the
+// coarse point. Coarse point J sits on fine point 2J, apart from the
+// right end.
+static void restrict_residual(mg_t *mg, level_t *fine, level_t *coarse){
+  double w, sum, len, H = fine->H, hp;
+  int J,i,g;
+  heat_exchange_halo(&fine->r[1], fine->nloc, 1, mg->left, mg->right, mg->comm);
+  for(J=0; J<coarse->nloc+2; J++){
+    coarse->u[J] = 0.0;
+    coarse->f[J] = 0.0;
+  }
+  for(J=1; J<=coarse->nloc; J++){
+    if(INTERIOR(coarse,J)){
+      g = 2*GLOBAL(coarse,J);
+      i = g - fine->gstart + 1;
+      hp = RIGHT(fine, g);
+      sum = 0.5*H * fine->r[i-1] + (H+hp)/2 * fine->r[i];
+      len = 0.5*H + (H+hp)/2;
+      if(g+1 < fine->n-1){
+        w = RIGHT(fine, g+1)/2;   // interpolation weight hp/(H+hp) times length (H+hp)/2
+        sum += w * fine->r[i+1];
+        len += w;
+      }
+      coarse->f[J] = sum/len;
+    }
+  }
+}
+
+// Linear interpolation of the coarse correction onto the fine grid
+static void prolong_correction(mg_t *mg, level_t *coarse, level_t *fine){
+  double H = fine->H, hp;
+  int j,g,I;
+  heat_exchange_halo(&coarse->u[1], coarse->nloc, 1, mg->left, mg->right, mg->comm);
+  for(j=1; j<=fine->nloc; j++){
+    if(INTERIOR(fine,j)){
+      g = GLOBAL(fine,j);
+      I = g/2 - coarse->gstart + 1;
+      hp = RIGHT(fine, g);
+      fine->u[j] += (g % 2 == 0) ? coarse->u[I] : (hp*coarse->u[I] + H*coarse->u[I+1])/(H+hp);
+    }
+  }
+}
+
+// Gather the coarsest level to the root and solve it exactly with the
+// Thomas algorithm
+static void coarse_solve(mg_t *mg, level_t *l){
+  MPI_Gatherv(&l->f[1], l->nloc, MPI_DOUBLE, mg->F, mg->counts, mg->displs, MPI_DOUBLE, 0, mg->comm);
+  MPI_Gatherv(&l->u[1], l->nloc, MPI_DOUBLE, mg->U, mg->counts, mg->displs, MPI_DOUBLE, 0, mg->comm);
+  if(mg->proc_id == 0 && l->n > 2){
+    int m = l->n-2, i;
+    double *cp = malloc(m * sizeof(double));
+    double *d = &mg->F[1];
+    double H = l->H, hp, a, b, c = 0.0;
+    for(i=0; i<m; i++){//row i is point i+1, a, b and c multiply points i, i+1 and i+2
+      hp = RIGHT(l, i+1);
+      a = 2/(H*(H+hp));
+      b = -2/(H*hp);
+      if(i == 0){
+        d[0] -= a*mg->U[0];
+      }
+      else{
+        b -= a*cp[i-1];
+        d[i] -= a*d[i-1];
+      }
+      c = 2/(hp*(H+hp));
+      if(i == m-1){
+        d[i] -= c*mg->U[l->n-1];
+      }
+      cp[i] = c/b;
+      d[i] /= b;
+    }
+    for(i=m-2; i>=0; i--){
+      d[i] -= cp[i]*d[i+1];
+    }
+    for(i=0; i<m; i++){
+      mg->U[i+1] = d[i];
+    }
+    free(cp);
+  }
+  MPI_Scatterv(mg->U, mg->counts, mg->displs, MPI_DOUBLE, &l->u[1], l->nloc, MPI_DOUBLE, 0, mg->comm);
+}
+
+static void vcycle(mg_t *mg, int k){
+  level_t *l = &mg->lev[k];
+  if(k == mg->nlev-1){
+    coarse_solve(mg, l);
+    return;
+  }
+  smooth(mg, l, MG_SWEEPS);
+  residual(mg, l);
+  restrict_residual(mg, l, &mg->lev[k+1]);
+  vcycle(mg, k+1);
+  prolong_correction(mg, &mg->lev[k+1], l);
+  smooth(mg, l, MG_SWEEPS);
+}
+
+static void alloc_level(level_t *l, int n, int nloc, int gstart, double H, double hl){
+  l->n = n;
+  l->nloc = nloc;
+  l->gstart = gstart;
+  l->H = H;
+  l->hl = hl;
+  l->u = calloc(nloc+2, sizeof(double));
+  l->f = calloc(nloc+2, sizeof(double));
+  l->r = calloc(nloc+2, sizeof(double));
+}
+
+// Solve for the steady state of the rod in place. row points at this
+// processor's first owned cell and must hold the fixed end
+// temperatures; its other cells are the starting guess. Runs V-cycles
+// until the largest residual is below tol or max_cycles have run.
+// Returns the number of cycles and sets resid to the final residual.
+// Aborts if the coarsest level would have more than MG_COARSE_MAX
+// points, when there are too many processors for the width.
+int heat_mg_steady(double *row, int nloc, int gstart, int width, double tol,
+                   int max_cycles, MPI_Comm comm, double *resid){
+  mg_t mg;
+  level_t *l;
+  int k, j, cycle, cs, ce, nc, mine, fewest;
+  double local;
+
+  mg.comm = comm;
+  MPI_Comm_rank(comm, &mg.proc_id);
+  MPI_Comm_size(comm, &mg.npes);
+  mg.left = (mg.proc_id > 0) ? mg.proc_id-1 : MPI_PROC_NULL;
+  mg.right = (mg.proc_id < mg.npes-1) ? mg.proc_id+1 : MPI_PROC_NULL;
+
+  alloc_level(&mg.lev[0], width, nloc, gstart, 1.0, 1.0);
+  for(j=0; j<nloc; j++){
+    mg.lev[0].u[j+1] = row[j];
+  }
+  mg.nlev = 1;
+  while(mg.nlev < MG_MAX_LEVELS){
+    l = &mg.lev[mg.nlev-1];
+    if(l->n < 5){
+      break;
+    }
+    nc = l->n/2+1;                        // the even fine points and the right end
+    cs = (l->gstart+1)/2;
+    ce = (l->gstart+l->nloc == l->n) ? nc : (l->gstart+l->nloc+1)/2;
+    mine = ce-cs;
+    MPI_Allreduce(&mine, &fewest, 1, MPI_INT, MPI_MIN, comm);
+    if(fewest < 2){
+      break;
+    }
+    // An odd interval count keeps the short last interval, an even one
+    // adds a whole interval to it
+    alloc_level(&mg.lev[mg.nlev], nc, ce-cs, cs, 2*l->H,
+                ((l->n-1) % 2 == 0) ? l->H + l->hl : l->hl);
+    mg.nlev++;
+  }
+
+  l = &mg.lev[mg.nlev-1];
+  if(l->n > MG_COARSE_MAX){
+    if(mg.proc_id == 0){
+      fprintf(stderr,"ERROR: multigrid coarsest level has %d points, more than %d, use fewer processors\n",
+              l->n,MG_COARSE_MAX);
+    }
+    MPI_Abort(comm, 1);
+  }
+  mg.counts = malloc(mg.npes * sizeof(int));
+  mg.displs = malloc(mg.npes * sizeof(int));
+  MPI_Allgather(&l->nloc, 1, MPI_INT, mg.counts, 1, MPI_INT, comm);
+  MPI_Allgather(&l->gstart, 1, MPI_INT, mg.displs, 1, MPI_INT, comm);
+  mg.U = mg.F = NULL;
+  if(mg.proc_id == 0){
+    mg.U = malloc(l->n * sizeof(double));
+    mg.F = malloc(l->n * sizeof(double));
+  }
+
+  *resid = 0.0;
+  for(cycle=1; cycle<=max_cycles; cycle++){
+    vcycle(&mg, 0);
+    residual(&mg, &mg.lev[0]);
+    local = 0.0;
+    for(j=1; j<=nloc; j++){
+      local = fmax(local, fabs(mg.lev[0].r[j]));
+    }
+    MPI_Allreduce(&local, resid, 1, MPI_DOUBLE, MPI_MAX, comm);
+    if(*resid < tol){
+      break;
+    }
+  }
+  if(cycle > max_cycles){
+    cycle = max_cycles;
+  }
+
+  for(j=0; j<nloc; j++){
+    row[j] = mg.lev[0].u[j+1];
+  }
+  for(k=0; k<mg.nlev; k++){
+    free(mg.lev[k].u);
+    free(mg.lev[k].f);
+    free(mg.lev[k].r);
+  }
+  free(mg.counts);
+  free(mg.displs);
+  free(mg.U);
+  free(mg.F);
+  return cycle;
+}
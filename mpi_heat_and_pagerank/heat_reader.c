@@ -0,0 +1,54 @@
+// Convert a binary heat result file written by mpi_heat back into the
+// temperature table that mpi_heat prints. Runs serially.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <heat.h>
+
+int main(int argc, char **argv){
+  if(argc < 2){
+    printf("usage: %s results.bin\n results.bin: file written by mpi_heat or mpi_heat_nd -o\n",argv[0]);
+    return 0;
+  }
+
+  FILE *f = fopen(argv[1],"rb");
+  if(f==NULL){
+    perror(argv[1]);
+    exit(1);
+  }
+  char buf[HEAT_HEADER_SIZE];
+  heat_header_t hdr;
+  if(fread(buf, 1, HEAT_HEADER_SIZE, f) != HEAT_HEADER_SIZE){
+    fprintf(stderr,"ERROR: %s is too short to hold a header\n",argv[1]);
+    exit(1);
+  }
+  memcpy(&hdr, buf, sizeof(heat_header_t));
+  if(!heat_header_check(&hdr, argv[1])){
+    exit(1);
+  }
+  int width = hdr.dims[0];
+  double *row = malloc(width * sizeof(double));
+  int t,y,z;
+  if(hdr.ndims == 1){
+    heat_print_table_header(stdout, width);
+  }
+  for(t=0; t<hdr.nsteps; t++){   // stream one row at a time so large runs fit in memory
+    for(z=0; z<hdr.dims[2]; z++){
+      if(hdr.ndims > 1){
+        heat_print_grid_header(stdout, hdr.ndims, z, hdr.first_step+t, width);
+      }
+      for(y=0; y<hdr.dims[1]; y++){
+        if(fread(row, sizeof(double), width, f) != width){
+          fprintf(stderr,"ERROR: %s ends after %d of %d steps\n",argv[1],t,hdr.nsteps);
+          exit(1);
+        }
+        //rods label rows by time step, plates and blocks by y
+        heat_print_table_row(stdout, (hdr.ndims == 1) ? hdr.first_step+t : y, row, width);
+      }
+    }
+  }
+  free(row);
+  fclose(f);
+  return 0;
+}
@@ -0,0 +1,190 @@
+// In-situ statistics for the rod. Each sampled time step every
+// processor boils its slice down to a few numbers, those are reduced to
+// the root and the root writes one CSV line, so nothing but the current
+// rows ever has to be kept or moved.
+//
+// A statistic is a function of this processor's slice plus the
+// reduction that combines the slices. To add one write the function and
+// add a line to the metrics table, it gets its own CSV column.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include <heat.h>
+
+typedef enum { STAT_MIN, STAT_MAX, STAT_SUM, STAT_NOPS } stat_op_t;
+
+typedef struct {
+  const char *name;             // CSV column
+  stat_op_t op;                 // how the slices combine
+  double (*local)(heat_stats_t *st, const double *row, int nloc, int gstart, int width);
+} metric_t;
+
+#define MAX_METRICS 16
+
+struct heat_stats {
+  MPI_Comm comm;
+  int proc_id;
+  FILE *out;                    // CSV output, root only
+  int nonblocking;              // overlap each reduction with the next time steps
+  double k;                     // thermal conductivity, for the fluxes
+  double threshold;             // report when the max temperature first falls to this
+  int threshold_step;           // -1 until it does
+  int nops[STAT_NOPS];          // metrics reduced with each op
+  double send[STAT_NOPS][MAX_METRICS];
+  double recv[STAT_NOPS][MAX_METRICS];
+  MPI_Request req[STAT_NOPS];
+  int pending;                  // time step of the reduction in flight, -1 if none
+};
+
+static double local_min(heat_stats_t *st, const double *row, int nloc, int gstart, int width){
+  double v = row[0];
+  int p;
+  for(p=1; p<nloc; p++){
+    v = (row[p] < v) ? row[p] : v;
+  }
+  return v;
+}
+
+static double local_max(heat_stats_t *st, const double *row, int nloc, int gstart, int width){
+  double v = row[0];
+  int p;
+  for(p=1; p<nloc; p++){
+    v = (row[p] > v) ? row[p] : v;
+  }
+  return v;
+}
+
+static double local_mean(heat_stats_t *st, const double *row, int nloc, int gstart, int width){
+  double v = 0.0;
+  int p;
+  for(p=0; p<nloc; p++){
+    v += row[p];
+  }
+  return v/width;
+}
+
+// Heat flowing out of the rod through each end per time step. Only the
+// processors holding the ends contribute, and they need to own the cell
+// next to the end as well.
+static double local_flux_left(heat_stats_t *st, const double *row, int nloc, int gstart, int width){
+  return (gstart == 0 && nloc > 1) ? st->k*(row[1] - row[0]) : 0.0;
+}
+
+static double local_flux_right(heat_stats_t *st, const double *row, int nloc, int gstart, int width){
+  return (gstart+nloc == width && nloc > 1) ? st->k*(row[nloc-2] - row[nloc-1]) : 0.0;
+}
+
+static const metric_t metrics[] = {
+  {"min",        STAT_MIN, local_min},
+  {"max",        STAT_MAX, local_max},
+  {"mean",       STAT_SUM, local_mean},
+  {"flux_left",  STAT_SUM, local_flux_left},
+  {"flux_right", STAT_SUM, local_flux_right},
+};
+#define NMETRICS ((int)(sizeof(metrics)/sizeof(metrics[0])))
+
+static MPI_Op mpi_op(stat_op_t op){
+  return (op == STAT_MIN) ? MPI_MIN : (op == STAT_MAX) ? MPI_MAX : MPI_SUM;
+}
+
+// Wait for the reduction in flight and have the root write it out
+static void finish(heat_stats_t *st){
+  double value[MAX_METRICS];
+  int used[STAT_NOPS] = {0};
+  int i;
+  if(st->pending < 0){
+    return;
+  }
+  MPI_Waitall(STAT_NOPS, st->req, MPI_STATUSES_IGNORE);
+  if(st->proc_id == 0){
+    fprintf(st->out,"%d",st->pending);
+    for(i=0; i<NMETRICS; i++){
+      value[i] = st->recv[metrics[i].op][used[metrics[i].op]++];
+      fprintf(st->out,",%.10g",value[i]);
+      if(strcmp(metrics[i].name,"max") == 0 && st->threshold_step < 0 && value[i] <= st->threshold){
+        st->threshold_step = st->pending;
+      }
+    }
+    fprintf(st->out,"\n");
+  }
+  st->pending = -1;
+}
+
+// Start collecting statistics over comm. The root writes them as CSV
+// to fname, or stdout if fname is "-". With nonblocking set each step's
+// reductions are only waited for when the next step is sampled.
+heat_stats_t *heat_stats_open(MPI_Comm comm, char *fname, int nonblocking,
+                              double k, double threshold){
+  heat_stats_t *st = malloc(sizeof(heat_stats_t));
+  int i;
+  st->comm = comm;
+  MPI_Comm_rank(comm, &st->proc_id);
+  st->nonblocking = nonblocking;
+  st->k = k;
+  st->threshold = threshold;
+  st->threshold_step = -1;
+  st->pending = -1;
+  st->out = NULL;
+  for(i=0; i<STAT_NOPS; i++){
+    st->nops[i] = 0;
+    st->req[i] = MPI_REQUEST_NULL;
+  }
+  for(i=0; i<NMETRICS; i++){
+    st->nops[metrics[i].op]++;
+  }
+  if(st->proc_id == 0){
+    st->out = (strcmp(fname,"-") == 0) ? stdout : fopen(fname,"w");
+    if(st->out == NULL){
+      perror(fname);
+      MPI_Abort(comm, 1);
+    }
+    fprintf(st->out,"step");
+    for(i=0; i<NMETRICS; i++){
+      fprintf(st->out,",%s",metrics[i].name);
+    }
+    fprintf(st->out,"\n");
+  }
+  return st;
+}
+
+// Sample time step step. row points at this processor's first owned
+// cell of that step. Collective over the processors in comm.
+void heat_stats_step(heat_stats_t *st, int step, const double *row,
+                     int nloc, int gstart, int width){
+  int used[STAT_NOPS] = {0};
+  int i, op;
+  finish(st);                   // the send buffers are about to be reused
+  for(i=0; i<NMETRICS; i++){
+    op = metrics[i].op;
+    st->send[op][used[op]++] = metrics[i].local(st, row, nloc, gstart, width);
+  }
+  for(op=0; op<STAT_NOPS; op++){
+    if(st->nops[op] > 0){
+      MPI_Ireduce(st->send[op], st->recv[op], st->nops[op], MPI_DOUBLE, mpi_op(op), 0,
+                  st->comm, &st->req[op]);
+    }
+  }
+  st->pending = step;
+  if(!st->nonblocking){
+    finish(st);
+  }
+}
+
+// Flush the last sample, report the threshold crossing and free st
+void heat_stats_close(heat_stats_t *st){
+  finish(st);
+  if(st->proc_id == 0){
+    if(st->threshold_step >= 0){
+      fprintf(stderr,"max temperature reached %g at time step %d\n",st->threshold,st->threshold_step);
+    }
+    if(st->out != stdout){
+      fclose(st->out);
+    }
+    else{
+      fflush(stdout);
+    }
+  }
+  free(st);
+}
@@ -0,0 +1,206 @@
+// Calls and bytes moved by each kind of collective, counted through the
+// MPI profiling interface: linking this file in puts a wrapper in front
+// of each routine below, which counts and hands over to the PMPI_
+// version. Counting starts with mpi_count_enable, until then the
+// wrappers only pass the calls on.
+//
+// The bytes are the payload each processor hands in and gets back, not
+// what the collective's algorithm sends over the wire, so they show how
+// the volume grows with the problem and the processors. A processor
+// counts what it sends plus what it receives.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+enum { C_ALLGATHER, C_ALLGATHERV, C_IALLGATHERV, C_ALLREDUCE, C_IALLREDUCE, C_REDUCE, C_IREDUCE,
+       C_ALLTOALL, C_ALLTOALLV, C_BCAST, C_GATHER, C_GATHERV, C_REDUCE_SCATTER, C_SENDRECV,
+       C_NCALLS };
+static const char *call_names[C_NCALLS] = {"Allgather", "Allgatherv", "Iallgatherv", "Allreduce",
+                                           "Iallreduce", "Reduce", "Ireduce", "Alltoall",
+                                           "Alltoallv", "Bcast", "Gather", "Gatherv",
+                                           "Reduce_scatter", "Sendrecv"};
+
+static int counting = 0;
+static double calls[C_NCALLS];
+static double bytes[C_NCALLS];
+
+// One call that sent nsend elements of stype and received nrecv of
+// rtype. A type is only looked at when there are elements of it, the
+// unused ones may be MPI_DATATYPE_NULL.
+static void count(int call, long long nsend, MPI_Datatype stype, long long nrecv, MPI_Datatype rtype){
+  int size;
+  if(counting){
+    calls[call]++;
+    if(nsend > 0){
+      PMPI_Type_size(stype, &size);
+      bytes[call] += (double) nsend*size;
+    }
+    if(nrecv > 0){
+      PMPI_Type_size(rtype, &size);
+      bytes[call] += (double) nrecv*size;
+    }
+  }
+}
+
+static long long total(const int *counts, MPI_Comm comm){
+  long long n = 0;
+  int npes, i;
+  PMPI_Comm_size(comm, &npes);
+  for(i=0; i<npes; i++){
+    n += counts[i];
+  }
+  return n;
+}
+
+static int is_root(int root, MPI_Comm comm){
+  int proc_id;
+  PMPI_Comm_rank(comm, &proc_id);
+  return proc_id == root;
+}
+
+// Start counting from zero, or stop with on = 0
+void mpi_count_enable(int on){
+  int i;
+  if(on && !counting){
+    for(i=0; i<C_NCALLS; i++){
+      calls[i] = bytes[i] = 0.0;
+    }
+  }
+  counting = on;
+}
+
+// Collectively reduce the counts over comm and have the root print the
+// calls and the bytes per processor, average and max, of each kind of
+// collective used. Does nothing unless counting is on.
+void mpi_count_report(MPI_Comm comm, FILE *out){
+  double sum[C_NCALLS], hi[C_NCALLS], ncalls[C_NCALLS];
+  int proc_id, npes, i;
+  if(!counting){
+    return;
+  }
+  counting = 0;                 // leave the report's own reductions out
+  MPI_Comm_rank(comm, &proc_id);
+  MPI_Comm_size(comm, &npes);
+  MPI_Reduce(bytes, sum, C_NCALLS, MPI_DOUBLE, MPI_SUM, 0, comm);
+  MPI_Reduce(bytes, hi, C_NCALLS, MPI_DOUBLE, MPI_MAX, 0, comm);
+  MPI_Reduce(calls, ncalls, C_NCALLS, MPI_DOUBLE, MPI_MAX, 0, comm);
+  if(proc_id == 0){
+    fprintf(out,"Collectives over %d processors, bytes sent and received per processor\n",npes);
+    fprintf(out,"%14s %8s %14s %14s\n","call","calls","avg","max");
+    for(i=0; i<C_NCALLS; i++){
+      if(ncalls[i] > 0){
+        fprintf(out,"%14s %8.0f %14.0f %14.0f\n",call_names[i],ncalls[i],sum[i]/npes,hi[i]);
+      }
+    }
+  }
+  counting = 1;
+}
+
+int MPI_Allgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                  void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm){
+  int npes;
+  PMPI_Comm_size(comm, &npes);
+  count(C_ALLGATHER, (sendbuf == MPI_IN_PLACE) ? 0 : sendcount, sendtype,
+        (long long) recvcount*npes, recvtype);
+  return PMPI_Allgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+}
+
+int MPI_Allgatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                   void *recvbuf, const int recvcounts[], const int displs[],
+                   MPI_Datatype recvtype, MPI_Comm comm){
+  count(C_ALLGATHERV, (sendbuf == MPI_IN_PLACE) ? 0 : sendcount, sendtype,
+        total(recvcounts, comm), recvtype);
+  return PMPI_Allgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, comm);
+}
+
+int MPI_Iallgatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                    void *recvbuf, const int recvcounts[], const int displs[],
+                    MPI_Datatype recvtype, MPI_Comm comm, MPI_Request *request){
+  count(C_IALLGATHERV, (sendbuf == MPI_IN_PLACE) ? 0 : sendcount, sendtype,
+        total(recvcounts, comm), recvtype);
+  return PMPI_Iallgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype,
+                          comm, request);
+}
+
+int MPI_Allreduce(const void *sendbuf, void *recvbuf, int n, MPI_Datatype type,
+                  MPI_Op op, MPI_Comm comm){
+  count(C_ALLREDUCE, n, type, n, type);
+  return PMPI_Allreduce(sendbuf, recvbuf, n, type, op, comm);
+}
+
+int MPI_Iallreduce(const void *sendbuf, void *recvbuf, int n, MPI_Datatype type,
+                   MPI_Op op, MPI_Comm comm, MPI_Request *request){
+  count(C_IALLREDUCE, n, type, n, type);
+  return PMPI_Iallreduce(sendbuf, recvbuf, n, type, op, comm, request);
+}
+
+int MPI_Reduce(const void *sendbuf, void *recvbuf, int n, MPI_Datatype type,
+               MPI_Op op, int root, MPI_Comm comm){
+  count(C_REDUCE, (sendbuf == MPI_IN_PLACE) ? 0 : n, type, is_root(root, comm) ? n : 0, type);
+  return PMPI_Reduce(sendbuf, recvbuf, n, type, op, root, comm);
+}
+
+int MPI_Ireduce(const void *sendbuf, void *recvbuf, int n, MPI_Datatype type,
+                MPI_Op op, int root, MPI_Comm comm, MPI_Request *request){
+  count(C_IREDUCE, (sendbuf == MPI_IN_PLACE) ? 0 : n, type, is_root(root, comm) ? n : 0, type);
+  return PMPI_Ireduce(sendbuf, recvbuf, n, type, op, root, comm, request);
+}
+
+int MPI_Alltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm){
+  int npes;
+  PMPI_Comm_size(comm, &npes);
+  count(C_ALLTOALL, (long long) sendcount*npes, sendtype,
+        (long long) recvcount*npes, recvtype);
+  return PMPI_Alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+}
+
+int MPI_Alltoallv(const void *sendbuf, const int sendcounts[], const int sdispls[],
+                  MPI_Datatype sendtype, void *recvbuf, const int recvcounts[],
+                  const int rdispls[], MPI_Datatype recvtype, MPI_Comm comm){
+  count(C_ALLTOALLV, total(sendcounts, comm), sendtype,
+        total(recvcounts, comm), recvtype);
+  return PMPI_Alltoallv(sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls,
+                        recvtype, comm);
+}
+
+int MPI_Bcast(void *buffer, int n, MPI_Datatype type, int root, MPI_Comm comm){
+  count(C_BCAST, is_root(root, comm) ? n : 0, type, is_root(root, comm) ? 0 : n, type);
+  return PMPI_Bcast(buffer, n, type, root, comm);
+}
+
+int MPI_Gather(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+               void *recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm){
+  int npes;
+  PMPI_Comm_size(comm, &npes);
+  count(C_GATHER, (sendbuf == MPI_IN_PLACE) ? 0 : sendcount, sendtype,
+        is_root(root, comm) ? (long long) recvcount*npes : 0, recvtype);
+  return PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm);
+}
+
+int MPI_Gatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                void *recvbuf, const int recvcounts[], const int displs[],
+                MPI_Datatype recvtype, int root, MPI_Comm comm){
+  count(C_GATHERV, (sendbuf == MPI_IN_PLACE) ? 0 : sendcount, sendtype,
+        is_root(root, comm) ? total(recvcounts, comm) : 0, recvtype);
+  return PMPI_Gatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype,
+                      root, comm);
+}
+
+int MPI_Reduce_scatter(const void *sendbuf, void *recvbuf, const int recvcounts[],
+                       MPI_Datatype type, MPI_Op op, MPI_Comm comm){
+  int proc_id;
+  PMPI_Comm_rank(comm, &proc_id);
+  count(C_REDUCE_SCATTER, total(recvcounts, comm), type, recvcounts[proc_id], type);
+  return PMPI_Reduce_scatter(sendbuf, recvbuf, recvcounts, type, op, comm);
+}
+
+int MPI_Sendrecv(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 int dest, int sendtag, void *recvbuf, int recvcount,
+                 MPI_Datatype recvtype, int source, int recvtag,
+                 MPI_Comm comm, MPI_Status *status){
+  count(C_SENDRECV, sendcount, sendtype, recvcount, recvtype);
+  return PMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf, recvcount,
+                       recvtype, source, recvtag, comm, status);
+}
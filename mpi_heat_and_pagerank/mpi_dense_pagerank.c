@@ -4,84 +4,33 @@
 #include <math.h>
 #include <errno.h>
 #include <mpi.h>
+#include <string.h>
+#include <omp.h>
+#include <pagerank.h>
+#include <mpi_timer.h>
 
 #define NAME_LEN 255
 
-// Simple wrapper around a dense matrix. Can access elements either
-// linearly through mat->all[i] or via 2d index through
-// mat->data[i][j]
-typedef struct {
-  double *all;                  // Array of all elements, allows for easy sharing of entire matrix
-  double **data;                // Pointers to individual rows to allow mat->data[r][c] access
-  int nrows, ncols;             // Number of rows and columns
-  int nnz;                      // Number of nonzeros in the matrix initially 
-} densemat;
-// Free a densemat
-void free_densemat(densemat *mat){
-  free(mat->all);
-  free(mat->data);
-  free(mat);
-}
-// Allocate a dense matrix of the given size. Initialize its elements
-// to 0.0
-densemat * allocate_densemat(int nrows, int ncols){
-  densemat * mat = malloc(sizeof(densemat));
-  mat->nrows = nrows;
-  mat->ncols = ncols;
-  mat->nnz = 0;
-  int i,j;
-  mat->all = malloc(nrows*ncols * sizeof(double *));
-  for(i=0; i<nrows*ncols; i++){
-    mat->all[i] = 0.0;
-  }
-  mat->data = malloc(nrows * sizeof(double**));
-  for(i=0; i<nrows; i++){
-    mat->data[i] = &mat->all[i*ncols];
-  }
-  return mat;
-}    
+// Phases reported by -timing, product through exchange are traced
+// every iteration by -trace
+enum { T_LOAD, T_NORMALIZE, T_PRODUCT, T_CHECK, T_EXCHANGE, T_OUTPUT, T_TOTAL, T_NPHASES };
+static const char *phase_names[T_NPHASES] = {"load", "normalize", "product", "check", "exchange",
+                                             "output", "total"};
+#define T_NTRACED (T_EXCHANGE - T_PRODUCT + 1)
+
+static const char *method_names[] = {"power", "gs", "extrap", "adaptive"};
 
-// Read a dense matrix from the given file. Assumes a square matrix in
-// the file.  Contents of the file are only row and column pairs whose
-// value is assumed 1.0.  The format of the file starts with the
-// number of rows and nonzeros (number of lines in file) on the first
-// line. Each subsequent line has a row/col entry whose value is
-// assumed to be 1.0
-densemat * load_row_col_as_densemat(char *fname){
-  FILE *f = fopen(fname,"r");
-  if(f==NULL){
-    perror(fname);
-    exit(1);
-  }
-  int nrows, nnz;
-  fscanf(f, "%d %d", &nrows, &nnz);
-  densemat *mat = allocate_densemat(nrows,nrows);
-  int i;
-  for(i=0; i<nnz; i++){
-    int row,col;
-    fscanf(f,"%d %d",&row,&col);
-    if(row >= nrows || col >= nrows){
-      fprintf(stderr,"ERROR: line %d has row/col %d %d for matrix with rows/cols %d %d\n",
-              i+1,row,col,nrows,nrows);
-      exit(1);
-    }
-    mat->data[row][col] = 1.0;
-    mat->nnz++;
-  }
-  assert(i==nnz);
-  fclose(f);
-  return mat;
-}
 int main(int argc, char **argv){
   int npes, proc_id, name_len;
   char proc_name[NAME_LEN];
-  MPI_Init (&argc, &argv);                      /* starts MPI */
+  int provided;
+  MPI_Init_thread (&argc, &argv, MPI_THREAD_FUNNELED, &provided); /* starts MPI, only the master thread calls it */
   MPI_Comm_rank (MPI_COMM_WORLD, &proc_id);     /* get current process id */
   MPI_Comm_size (MPI_COMM_WORLD, &npes);        /* get number of processes */
   MPI_Get_processor_name(proc_name, &name_len); /* get the symbolic host name */
 
   if(argc < 3){
-    printf("usage: %s row_col.txt damping\n  0.0 < damping <= 1.0\n",argv[0]);
+    printf("usage: %s row_col.txt damping [-method power|gs|extrap|adaptive] [-2d] [-batch vectors.txt] [-warm ranks.bin] [-delta changes.txt] [-save_ranks ranks.bin] [-save_graph graph.bin] [-pattern] [-timing] [-trace file.csv|file.json] [-top k] [-o ranks.bin] [-shared]\n  row_col.txt: text edge list, or a binary graph from pr_convert\n  0.0 < damping <= 1.0\n  -method: power iteration (default), Gauss-Seidel, power with quadratic extrapolation every %d steps, or adaptive power iteration that freezes converged pages\n  -2d: split the matrix in square blocks over a grid of processors, needs a square number of them and the power method\n  -batch: iterate a batch of rank vectors together, one per line of vectors.txt as damping [teleport pages], the damping argument is ignored\n  -warm ranks.bin: start from ranks saved by an earlier run\n  -delta changes.txt: add and remove links before starting, one per line as + row col or - row col\n  -save_ranks ranks.bin, -save_graph graph.bin: save the final ranks and the graph with the changes for the next run\n  -pattern: keep only the columns of the links, packed as varint gaps, for the power method\n  -timing: report the time spent in each phase, min/avg/max over processors, and the bytes each collective moved, to stderr\n  -trace: write the change, norm and max/avg seconds of each phase of every iteration, as JSON if the name ends in .json and CSV otherwise\n  -top: print only the k pages with the highest ranks instead of every rank\n  -o: write the ranks in parallel as n doubles in page order instead of printing them\n  -shared: keep one rank vector per node in shared memory, exchanged between nodes by one processor each, for the power and adaptive methods\n  PAGERANK_NUMTHREADS: environment variable, threads per processor for the matrix products\n",argv[0],PR_EXTRAP_EVERY);
     return -1;
   }
    
@@ -90,169 +39,544 @@ int main(int argc, char **argv){
   int r,c,i;
   int MAX_ITER = 10000;
   int iter;
-  int elements_per_proc;
-  int surplus;
   int *counts;
   int *displs;
-  int *displsmod;
-  int *countsmod;
   double TOL = 1e-3;
   double change = TOL*10;
   double cur_norm;
-  double *cur_ranks;
-  double *old_ranks;
-  double *indiv_cur_ranks;
-  densemat *mat;
-  densemat *gathermat;
-  densemat *scattermat;
+  double *cur_ranks = NULL;
+  double *old_ranks = NULL;
+  double *indiv_cur_ranks = NULL;
+  double *tmp;
+  double sums[4], totals[4];    // this proc's and everyone's change, norm, teleport and frozen rows
+  MPI_Request reqs[2];
+  long long nedges;             // edges in the file
+  int *my_edges;                // row,col pairs of the edges in this proc's rows
+  int my_nedges;
+  csr_t *A;                     // this proc's rows of the link matrix
+  int *outdeg;                  // links out of each page, the column counts
   double diff;
   double damping_factor;
-  double *colsums;
-  double zelem;
+  double teleport;              // rank every page gets from the damping and from pages with no links
+  pr_method_t method = PR_POWER;
+  double *prev_ranks = NULL;    // this proc's ranks from two and three iterations back, for extrapolation
+  double *prev2_ranks = NULL;
+  double step_change = 0.0;     // this proc's change from the power step an extrapolation replaced
+  int extrapolated = 0;
+  int rescale = 0;              // the ranks no longer sum to one and need normalizing
+  int *active = NULL;           // rows still being recomputed by the adaptive method
+  int nactive = 0;
+  double nfrozen = 0.0;         // rows the last adaptive step left out, everywhere
+  double scale = 1.0;           // what the adaptive method scales old_ranks by as it reads them
+  int split_2d = 0;             // checkerboard split of the matrix instead of rows
+  char *batch_file = NULL;      // damping factors and teleport pages of a batch of vectors
+  char *warm_file = NULL;       // ranks from an earlier run to start from
+  char *delta_file = NULL;      // links added and removed since the graph was saved
+  char *save_ranks = NULL;      // where to save the final ranks
+  char *save_graph = NULL;      // where to save the graph after the changes
+  int *order = NULL;            // old number of each page if pr_convert renumbered them
+  int use_pattern = 0;          // store the links without their values
+  pr_pattern_t *pattern = NULL;
+  int timing = 0;               // report per phase times and collective bytes
+  mpi_timer_t tm;
+  char *trace_file = NULL;      // per iteration trace
+  pr_trace_t *trace = NULL;
+  double traced[T_NTRACED] = {0.0}; // phase times at the end of the last iteration
+  double secs[T_NTRACED];
+  int top = 0;                  // print only this many of the highest ranked pages
+  char *out_file = NULL;        // binary rank vector written instead of the printed ranks
+  int use_shared = 0;           // one rank vector per node
+  pr_shared_t *shared = NULL;
+  int p;
 
-  if(proc_id == root_proc){//things only proc0 needs to do
-    damping_factor = atof(argv[2]);
-    mat = load_row_col_as_densemat(argv[1]);
-    n = mat->nrows; //store N for NxN so the other processors can know the amount of columns/rows
-    printf("Loaded %s: %d rows, %d nonzeros\n",argv[1],mat->nrows,mat->nnz);
-    // Allocate space for the page ranks and a second array to track
-    // page ranks from the last iterations
-    cur_ranks = malloc(mat->nrows * sizeof(double));
-    old_ranks = malloc(mat->nrows * sizeof(double));
+  for(p=3; p<argc; p++){//optional flags after the positional args
+    if(strcmp(argv[p],"-method") == 0 && p+1 < argc){
+      p++;
+      for(i=0; i<4 && strcmp(argv[p],method_names[i]) != 0; i++);
+      if(i == 4){
+        if(proc_id == root_proc){ printf("unknown method %s\n",argv[p]); }
+        MPI_Finalize();
+        return 0;
+      }
+      method = i;
+    }
+    else if(strcmp(argv[p],"-2d") == 0){
+      split_2d = 1;
+    }
+    else if(strcmp(argv[p],"-batch") == 0 && p+1 < argc){
+      batch_file = argv[++p];
+    }
+    else if(strcmp(argv[p],"-warm") == 0 && p+1 < argc){
+      warm_file = argv[++p];
+    }
+    else if(strcmp(argv[p],"-delta") == 0 && p+1 < argc){
+      delta_file = argv[++p];
+    }
+    else if(strcmp(argv[p],"-save_ranks") == 0 && p+1 < argc){
+      save_ranks = argv[++p];
+    }
+    else if(strcmp(argv[p],"-save_graph") == 0 && p+1 < argc){
+      save_graph = argv[++p];
+    }
+    else if(strcmp(argv[p],"-pattern") == 0){
+      use_pattern = 1;
+    }
+    else if(strcmp(argv[p],"-timing") == 0){
+      timing = 1;
+    }
+    else if(strcmp(argv[p],"-trace") == 0 && p+1 < argc){
+      trace_file = argv[++p];
+    }
+    else if(strcmp(argv[p],"-top") == 0 && p+1 < argc){
+      top = atoi(argv[++p]);
+      if(top < 1){
+        if(proc_id == root_proc){ printf("-top needs at least one page\n"); }
+        MPI_Finalize();
+        return 0;
+      }
+    }
+    else if(strcmp(argv[p],"-o") == 0 && p+1 < argc){
+      out_file = argv[++p];
+    }
+    else if(strcmp(argv[p],"-shared") == 0){
+      use_shared = 1;
+    }
+    else{
+      if(proc_id == root_proc){ printf("unknown option %s\n",argv[p]); }
+      MPI_Finalize();
+      return 0;
+    }
+  }
 
-    //only proc0 needs to do this since we broadcast old ranks
-    for(c=0; c<(mat->nrows); c++){
-      cur_ranks[c] = 1.0 / mat->nrows;
-      old_ranks[c] = cur_ranks[c];
+  //check env variable for number of threads
+  char *nthreads_str = getenv("PAGERANK_NUMTHREADS");
+  if(nthreads_str != NULL){
+    omp_set_num_threads(atoi(nthreads_str));
+  }
+
+  damping_factor = atof(argv[2]);
+  if(batch_file != NULL && (split_2d || method != PR_POWER)){
+    if(proc_id == root_proc){ printf("-batch runs the power method over a split by rows only\n"); }
+    MPI_Finalize();
+    return 0;
+  }
+  if((split_2d || batch_file != NULL) &&
+     (warm_file != NULL || delta_file != NULL || save_ranks != NULL || save_graph != NULL)){
+    if(proc_id == root_proc){ printf("-warm, -delta and -save_* work with the split by rows only\n"); }
+    MPI_Finalize();
+    return 0;
+  }
+  if((split_2d || batch_file != NULL) && (timing || trace_file != NULL || top > 0 || out_file != NULL)){
+    if(proc_id == root_proc){ printf("-timing, -trace, -top and -o work with the split by rows only\n"); }
+    MPI_Finalize();
+    return 0;
+  }
+  if(use_shared && (split_2d || batch_file != NULL || method == PR_GS || method == PR_EXTRAP)){
+    if(proc_id == root_proc){ printf("-shared runs the power or adaptive method over a split by rows only\n"); }
+    MPI_Finalize();
+    return 0;
+  }
+  if(use_pattern && (split_2d || batch_file != NULL || method != PR_POWER)){
+    if(proc_id == root_proc){ printf("-pattern runs the power method over a split by rows only\n"); }
+    MPI_Finalize();
+    return 0;
+  }
+  if(split_2d){
+    int q = (int) (sqrt((double) npes) + 0.5);
+    if(q*q != npes || method != PR_POWER){
+      if(proc_id == root_proc){ printf("-2d needs a square number of processors and the power method\n"); }
+      MPI_Finalize();
+      return 0;
     }
+    pagerank_2d(MPI_COMM_WORLD, argv[1], damping_factor, TOL, MAX_ITER);
+    MPI_Finalize();
+    return 0;
+  }
+  mpi_timer_init(&tm, timing || trace_file != NULL, T_NPHASES, phase_names);
+  mpi_count_enable(timing);
+  MPI_Barrier(MPI_COMM_WORLD);  // start everyone's clocks together
+  mpi_timer_start(&tm, T_TOTAL);
+  mpi_timer_start(&tm, T_LOAD);
+  // Every proc reads a piece of the file and keeps the edges in its
+  // rows. A binary graph from pr_convert comes with its rows and out
+  // degrees ready to use.
+  if(pr_is_binary(MPI_COMM_WORLD, argv[1])){
+    A = pr_read_binary(MPI_COMM_WORLD, argv[1], npes, 1, &n, &nedges, &outdeg, &order);
+  }
+  else{
+    my_edges = load_row_col_parallel(MPI_COMM_WORLD, argv[1], npes, 1, &n, &nedges, &my_nedges);
+    r = block_range(n, npes, proc_id, &c);
+    A = csr_from_edges(r, c, n, my_edges, my_nedges);
+    free(my_edges);
+    //every proc needs every page's out degree to scale its own rows
+    outdeg = calloc(n, sizeof(int));
+    csr_col_counts(A, outdeg);
+    MPI_Allreduce(MPI_IN_PLACE, outdeg, n, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  }
+  if(proc_id == root_proc){//things only proc0 needs to do
+    printf("Loaded %s: %d rows, %lld nonzeros\n",argv[1],n,nedges);
   }//end pro0
-
-  MPI_Bcast(&n, 1, MPI_INT, root_proc, MPI_COMM_WORLD); //send the amount of NxN to everyone
-  MPI_Bcast(&damping_factor, 1, MPI_DOUBLE, root_proc, MPI_COMM_WORLD); //send the amount of damping to everyone
-  //malloc the correct amounts
-  colsums = malloc(n*sizeof(double));
+  if(delta_file != NULL){
+    // Each proc changes its own rows, then everyone patches the out
+    // degrees with the changes that took
+    int ndelta, nchanged = 0;
+    int *delta = read_delta(MPI_COMM_WORLD, delta_file, n, &ndelta);
+    int *applied = malloc((ndelta > 0 ? ndelta : 1) * sizeof(int));
+    if(order != NULL){//the changes use the old page numbers
+      int *renumber = pr_invert_order(order, n);
+      for(i=0; i<ndelta; i++){
+        delta[3*i+1] = renumber[delta[3*i+1]];
+        delta[3*i+2] = renumber[delta[3*i+2]];
+      }
+      free(renumber);
+    }
+    csr_apply_delta(A, delta, ndelta, applied);
+    MPI_Allreduce(MPI_IN_PLACE, applied, ndelta, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    for(i=0; i<ndelta; i++){
+      outdeg[delta[3*i+2]] += applied[i];
+      nchanged += (applied[i] != 0);
+    }
+    if(proc_id == root_proc){
+      printf("Applied %d of %d link changes from %s\n",nchanged,ndelta,delta_file);
+    }
+    free(delta);
+    free(applied);
+  }
+  if(save_graph != NULL){
+    pr_write_binary(MPI_COMM_WORLD, save_graph, A, n, outdeg, 0, order);
+  }
+  mpi_timer_stop(&tm, T_LOAD);
+  mpi_timer_start(&tm, T_NORMALIZE);
+  //every proc's share of the ranks, for gathering them
   counts = malloc(npes * sizeof(int));
   displs = malloc(npes * sizeof(int));
-  countsmod = malloc(npes * sizeof(int));
-  displsmod = malloc(npes * sizeof(int));
-  elements_per_proc = n/npes;
-  surplus = n % npes;
+  MPI_Allgather(&A->nrows, 1, MPI_INT, counts, 1, MPI_INT, MPI_COMM_WORLD);
+  MPI_Allgather(&A->first_row, 1, MPI_INT, displs, 1, MPI_INT, MPI_COMM_WORLD);
+  csr_normalize(A, outdeg);
+  if(use_pattern){//the columns and out degrees are all the product needs
+    double bytes_csr, bytes_pattern;
+    pattern = pattern_from_csr(A, outdeg);
+    bytes_csr = A->nnz > 0 ? (double) (A->nnz*(sizeof(int)+sizeof(double)) + (A->nrows+1)*sizeof(int)) / A->nnz : 0.0;
+    bytes_pattern = pattern_bytes_per_link(pattern);
+    free(A->colind);
+    free(A->val);
+    A->colind = NULL;
+    A->val = NULL;
+    MPI_Allreduce(MPI_IN_PLACE, &bytes_csr, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &bytes_pattern, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    if(proc_id == root_proc){
+      printf("Pattern storage: %.2f bytes per link, %.2f in CSR (most on any processor)\n",
+             bytes_pattern,bytes_csr);
+    }
+  }
 
-  //for uneven processors
-  for(i=0; i<npes; i++){
-      counts[i] = (i<surplus) ? elements_per_proc+1 : elements_per_proc;
-      displs[i] = (i==0) ? 0 : displs[i-1]+counts[i-1];
+  if(batch_file != NULL){//every vector of the batch shares this matrix
+    pagerank_batch(MPI_COMM_WORLD, A, outdeg, n, counts, displs, batch_file, order, TOL, MAX_ITER);
+    csr_free(A);
+    free(order);
+    free(outdeg);
+    free(counts);
+    free(displs);
+    MPI_Finalize();
+    return 0;
   }
-  //this made scatterv easier, modify all values by the number of cols so we can use mat->all
-  for(i=0; i<npes; i++){
-      countsmod[i] = counts[i] * n;
-      displsmod[i] = displs[i] * n;
+
+  // Allocate space for the page ranks and a second array to track
+  // page ranks from the last iterations. Every proc keeps the whole
+  // vector since its rows can link to any page.
+  if(use_shared){
+    shared = pr_shared_open(MPI_COMM_WORLD, n, counts, displs);
+    if(shared == NULL && proc_id == root_proc){
+      printf("Processors on a node do not hold one run of pages, keeping the ranks per processor\n");
+    }
   }
-  if(proc_id != root_proc){ //allocate space for oldranks all but root
-    old_ranks = malloc(n * sizeof(double));
-    mat = allocate_densemat(n,n);//all other processors needs to have atleast a blank square
+  if(shared != NULL){//each proc starts its own pages, then the nodes swap theirs
+    cur_ranks = pr_shared_vec(shared, 0);
+    old_ranks = pr_shared_vec(shared, 1);
+    tmp = (warm_file != NULL) ? malloc(n * sizeof(double)) : NULL;
+    if(warm_file != NULL){
+      pr_read_ranks(MPI_COMM_WORLD, warm_file, tmp, n, order);
+    }
+    for(r=0; r<A->nrows; r++){
+      c = A->first_row + r;
+      cur_ranks[c] = (tmp != NULL) ? tmp[c] : 1.0 / n;
+      old_ranks[c] = cur_ranks[c];
+    }
+    free(tmp);
+    pr_shared_exchange(shared, cur_ranks);
   }
-  scattermat = allocate_densemat(counts[proc_id],n);
-  indiv_cur_ranks = malloc(scattermat->nrows * sizeof(double));
-
-  MPI_Scatterv(mat->all, countsmod,displsmod, MPI_DOUBLE, //scatter the mat values from p0 to all
-   	       scattermat->all, countsmod[proc_id], MPI_DOUBLE,
-  	       root_proc, MPI_COMM_WORLD);
-
-  //start normalize 
-  for(c=0; c<n; c++){
-      colsums[c] = 0.0;
+  else{
+    cur_ranks = malloc(n * sizeof(double));
+    old_ranks = malloc(n * sizeof(double));
+    if(warm_file != NULL){//a small change to the graph barely moves the ranks
+      pr_read_ranks(MPI_COMM_WORLD, warm_file, cur_ranks, n, order);
+      memcpy(old_ranks, cur_ranks, n * sizeof(double));
     }
-  for(r=0; r<counts[proc_id]; r++){
-    for(c=0; c<n; c++){
-	colsums[c] += scattermat->data[r][c];
+    else{
+      for(c=0; c<n; c++){
+        cur_ranks[c] = 1.0 / n;
+        old_ranks[c] = cur_ranks[c];
+      }
     }
   }
-  //need to make every processor have the colsums for the division step
-  MPI_Allreduce(MPI_IN_PLACE, colsums, n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 
-  for(r=0; r<counts[proc_id]; r++){
-    for(c=0; c<n; c++){
-      scattermat->data[r][c] /= colsums[c];
+  // The new ranks of this proc's pages, written straight into the
+  // shared vector when there is one
+  if(shared == NULL){
+    indiv_cur_ranks = malloc((counts[proc_id] > 0 ? counts[proc_id] : 1) * sizeof(double));
+  }
+  if(method == PR_EXTRAP){
+    prev_ranks = malloc((counts[proc_id] > 0 ? counts[proc_id] : 1) * sizeof(double));
+    prev2_ranks = malloc((counts[proc_id] > 0 ? counts[proc_id] : 1) * sizeof(double));
+  }
+  if(method == PR_ADAPTIVE){//every row starts out active
+    active = malloc((counts[proc_id] > 0 ? counts[proc_id] : 1) * sizeof(int));
+    for(r=0; r<counts[proc_id]; r++){
+      active[nactive++] = r;
     }
   }
-  //end normalize
 
-  //apply damping
-  zelem = (1.0-damping_factor) / n;
-  for(r=0; r<counts[proc_id]; r++){
-    for(c=0; c<n; c++){
-      if(scattermat->data[r][c] != 0.0){ // Scale down nonzero entries
-	scattermat->data[r][c] *= damping_factor;
-      }
-      scattermat->data[r][c] += zelem; // Every entry increases a little
-    }
-  }//end damping
+  // Damping is not stored in the matrix. Each new rank is the damped
+  // product with the link matrix plus an equal share of the rest: the
+  // (1-damping) teleport mass and the rank of pages with no links,
+  // which would otherwise drain away. Each proc adds up that share for
+  // its own pages and it is summed along with the change.
+  sums[2] = 0.0;
+  for(r=0; r<A->nrows; r++){
+    c = A->first_row + r;
+    sums[2] += (outdeg[c] == 0) ? old_ranks[c] : (1.0-damping_factor)*old_ranks[c];
+  }
+  MPI_Allreduce(&sums[2], &teleport, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  teleport /= n;
+  mpi_timer_stop(&tm, T_NORMALIZE);
+  if(trace_file != NULL){
+    trace = pr_trace_open(MPI_COMM_WORLD, trace_file, T_NTRACED, &phase_names[T_PRODUCT]);
+  }
 
   if(proc_id == root_proc){
   printf("Beginning Computation\n\n%4s %8s %8s\n","ITER","DIFF","NORM");
   }
-  for(iter=1; change > TOL && iter<=MAX_ITER; iter++){
-    // old_ranks assigned to cur_ranks
-    if(proc_id == root_proc){
-      for(c=0; c<mat->ncols; c++){//sets old ranks to current ranks
-	old_ranks[c] = cur_ranks[c];
+  // A partial adaptive step says nothing about the frozen pages, so the
+  // run only stops on a step that recomputed every page
+  for(iter=1; (change > TOL || nfrozen > 0) && iter<=MAX_ITER; iter++){
+    // old_ranks assigned to cur_ranks, swapping the arrays is enough
+    // since every entry of cur_ranks is rewritten
+    tmp = old_ranks;
+    old_ranks = cur_ranks;
+    cur_ranks = tmp;
+    if(shared != NULL){
+      indiv_cur_ranks = &cur_ranks[A->first_row];
+    }
+
+    mpi_timer_start(&tm, T_PRODUCT);
+    if(rescale){//extrapolation and Gauss-Seidel do not keep the ranks summing to one
+      for(c=0; c<n; c++){
+        old_ranks[c] /= cur_norm;
       }
+      teleport /= cur_norm;
+      rescale = 0;
     }
-    MPI_Bcast(old_ranks, n, MPI_DOUBLE, root_proc, MPI_COMM_WORLD);//broadcast old ranks
-    change = 0.0;
-    cur_norm = 0.0;
 
-    // Compute matrix-vector product: cur_ranks = Matrix * old_ranks 
-    for(r=0; r<scattermat->nrows; r++){
-      // Dot product of matrix row with old_ranks column
-      indiv_cur_ranks[r] = 0.0;
-      for(c=0; c<scattermat->ncols; c++){
-	indiv_cur_ranks[r] += scattermat->data[r][c] * old_ranks[c];
+    // Compute matrix-vector product: cur_ranks = Matrix * old_ranks,
+    // by the chosen method
+    if(method == PR_GS){//sweep in place over a copy, own rows see their updates straight away
+      memcpy(cur_ranks, old_ranks, n * sizeof(double));
+      csr_gs_sweep(A, cur_ranks, damping_factor, teleport);
+      memcpy(indiv_cur_ranks, &cur_ranks[A->first_row], A->nrows * sizeof(double));
+    }
+    else if(method == PR_ADAPTIVE){//frozen rows keep their last value
+      // Thaw everything now and then, in case a page froze early, and
+      // after a partial step that looked converged, to check it
+      if(iter % PR_EXTRAP_EVERY == 0 || change <= TOL){
+        for(r=0, nactive=0; r<A->nrows; r++){
+          active[nactive++] = r;
+        }
+      }
+      for(r=0; r<A->nrows; r++){
+        indiv_cur_ranks[r] = scale*old_ranks[A->first_row + r];
+      }
+      csr_spmv_rows(A, old_ranks, indiv_cur_ranks, active, nactive);
+      sums[3] = A->nrows - nactive;
+      for(i=0, p=0; i<nactive; i++){
+        r = active[i];
+        c = A->first_row + r;
+        indiv_cur_ranks[r] = scale*(damping_factor*indiv_cur_ranks[r] + teleport);
+        diff = indiv_cur_ranks[r] - scale*old_ranks[c];
+        if((diff>0 ? diff : -diff) > PR_ADAPTIVE_TOL*scale*old_ranks[c]){
+          active[p++] = r;
+        }
+      }
+      nactive = p;
+    }
+    else if(pattern != NULL){//the sums come out of the same pass
+      pattern_power_step(pattern, old_ranks, indiv_cur_ranks, damping_factor, teleport, sums);
+    }
+    else{
+      csr_spmv(A, old_ranks, indiv_cur_ranks);
+      for(r=0; r<A->nrows; r++){
+        indiv_cur_ranks[r] = damping_factor*indiv_cur_ranks[r] + teleport;
+      }
+    }
+    if(method == PR_EXTRAP){
+      // Quadratic extrapolation (Kamvar et al.): take the last four
+      // iterates to be the answer plus two eigenvectors that die off,
+      // fit the differences by least squares and drop them. The 2x2
+      // normal equations need five dot products over all pages, summed
+      // with the power step's change, which decides if it is worth it.
+      if(iter > 3 && iter % PR_EXTRAP_EVERY == 0){
+        double dots[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}, det, g1, g2;
+        for(r=0; r<A->nrows; r++){
+          double x3 = prev2_ranks[r], x1 = old_ranks[A->first_row + r];
+          double y2 = prev_ranks[r] - x3, y1 = x1 - x3, y0 = indiv_cur_ranks[r] - x3;
+          dots[0] += y2*y2;
+          dots[1] += y2*y1;
+          dots[2] += y1*y1;
+          dots[3] += y2*y0;
+          dots[4] += y1*y0;
+          dots[5] += fabs(indiv_cur_ranks[r] - x1);
+        }
+        step_change = dots[5];
+        MPI_Allreduce(MPI_IN_PLACE, dots, 6, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        det = dots[0]*dots[2] - dots[1]*dots[1];
+        if(dots[5] > TOL && det > 1e-12*dots[0]*dots[2]){
+          g1 = -(dots[2]*dots[3] - dots[1]*dots[4]) / det;
+          g2 = -(dots[0]*dots[4] - dots[1]*dots[3]) / det;
+          for(r=0; r<A->nrows; r++){//keep the power step where a page would go negative
+            double x = (g1+g2+1)*prev_ranks[r] + (g2+1)*old_ranks[A->first_row + r] + indiv_cur_ranks[r];
+            if(x > 0.0){
+              indiv_cur_ranks[r] = x;
+            }
+          }
+          extrapolated = 1;
+          rescale = 1;
+        }
       }
+      memcpy(prev2_ranks, prev_ranks, A->nrows * sizeof(double));
+      memcpy(prev_ranks, &old_ranks[A->first_row], A->nrows * sizeof(double));
     }
-    //gather the smaller chunks back into current ranks on p0
-    MPI_Gatherv(indiv_cur_ranks, counts[proc_id], MPI_DOUBLE,
-    	       cur_ranks, counts, displs, MPI_DOUBLE,
-    	       root_proc, MPI_COMM_WORLD);
-  
+    mpi_timer_stop(&tm, T_PRODUCT);
+
+    // This proc's part of the change, the norm and the next teleport
+    // share, which the pattern step already added up
+    mpi_timer_start(&tm, T_CHECK);
+    if(method != PR_ADAPTIVE){
+      sums[3] = 0.0;
+    }
+    if(pattern == NULL){
+      sums[0] = sums[1] = sums[2] = 0.0;
+      for(r=0; r<A->nrows; r++){
+        c = A->first_row + r;
+        diff = indiv_cur_ranks[r] - scale*old_ranks[c]; //compute the difference
+        sums[0] += diff>0 ? diff : -diff;
+        sums[1] += indiv_cur_ranks[r]; // Tracked to detect any errors
+        sums[2] += (outdeg[c] == 0) ? indiv_cur_ranks[r] : (1.0-damping_factor)*indiv_cur_ranks[r];
+      }
+    }
+    if(extrapolated){//the stopping test goes by the power step, the jump is no residual
+      sums[0] = step_change;
+      extrapolated = 0;
+    }
+    mpi_timer_stop(&tm, T_CHECK);
+    //everyone gets the new ranks and the totals, the two collectives
+    //run at the same time
+    mpi_timer_start(&tm, T_EXCHANGE);
+    MPI_Iallreduce(sums, totals, (method == PR_ADAPTIVE) ? 4 : 3, MPI_DOUBLE, MPI_SUM,
+                   MPI_COMM_WORLD, &reqs[1]);
+    if(shared != NULL){//node leaders swap whole nodes' pages while the totals are summed
+      reqs[0] = MPI_REQUEST_NULL;
+      pr_shared_exchange(shared, cur_ranks);
+    }
+    else{
+      MPI_Iallgatherv(indiv_cur_ranks, counts[proc_id], MPI_DOUBLE,
+                      cur_ranks, counts, displs, MPI_DOUBLE,
+                      MPI_COMM_WORLD, &reqs[0]);
+    }
+    MPI_Waitall(2, reqs, MPI_STATUSES_IGNORE);
+    change = totals[0];
+    cur_norm = totals[1];
+    if(method == PR_GS){
+      // A sweep does not keep the ranks summing to one. The next sweep
+      // starts from them scaled back, with the teleport scaled along,
+      // rather than pinning the total through the teleport, which
+      // pulls every page a little off each sweep.
+      rescale = 1;
+    }
+    teleport = totals[2] / n;
+    if(method == PR_ADAPTIVE){
+      // Frozen pages do not keep the ranks summing to one either. The
+      // shared vectors cannot be rescaled in place by every processor,
+      // so the next step scales the ranks as it reads them.
+      scale = 1.0 / cur_norm;
+      nfrozen = totals[3];
+    }
+    mpi_timer_stop(&tm, T_EXCHANGE);
+
     if(proc_id == root_proc){
-      for(c=0; c<n; c++){
-       	diff = cur_ranks[c] - old_ranks[c]; //compute the difference
-       	change += diff>0 ? diff : -diff;
-       	cur_norm += cur_ranks[c]; // Tracked to detect any errors
-       }
       printf("%3d: %8.2e %8.2e\n",iter,change,cur_norm);
-    }   
-    MPI_Bcast(&change, 1, MPI_DOUBLE, root_proc, MPI_COMM_WORLD); //broadcast the loop condition
+    }
+    if(trace != NULL){//this iteration's share of each traced phase
+      for(i=0; i<T_NTRACED; i++){
+        secs[i] = tm.total[T_PRODUCT+i] - traced[i];
+        traced[i] = tm.total[T_PRODUCT+i];
+      }
+      pr_trace_iter(trace, iter, change, cur_norm, secs);
+    }
+  }
+  if(trace != NULL){
+    pr_trace_close(trace);
   }
 
-  if(proc_id == root_proc){//proc0 printing
-    if(change < TOL){
-      printf("CONVERGED\n");
-    }
-    else{
-      printf("MAX ITERATION REACHED\n");
+  mpi_timer_start(&tm, T_OUTPUT);
+  if(save_ranks != NULL){//saved in the old page numbers, for any numbering of the graph
+    pr_write_ranks(MPI_COMM_WORLD, save_ranks, cur_ranks, A->first_row, A->nrows, n, order,
+                   damping_factor, change);
+  }
+  if(out_file != NULL){//every proc writes its own pages
+    pr_write_vector(MPI_COMM_WORLD, out_file, cur_ranks, A->first_row, A->nrows, order);
+  }
+  if(top > 0){//every proc picks from its own pages
+    pr_print_top(MPI_COMM_WORLD, stdout, change, TOL, cur_ranks, A->first_row, A->nrows,
+                 order, top);
+  }
+  else if(out_file != NULL){
+    if(proc_id == root_proc){
+      printf("%s\n\nPAGE RANKS written to %s\n",(change < TOL) ? "CONVERGED" : "MAX ITERATION REACHED",out_file);
     }
-    printf("\nPAGE RANKS\n");
-    for(r=0; r<mat->nrows; r++){
-      printf("%.8f\n",cur_ranks[r]);
+  }
+  else if(proc_id == root_proc){//proc0 printing
+    if(order != NULL){
+      pr_unpermute(cur_ranks, order, n);
     }
+    pr_print_ranks(stdout, change, TOL, cur_ranks, n);
   }//end proc0
+  mpi_timer_stop(&tm, T_OUTPUT);
+  mpi_timer_stop(&tm, T_TOTAL);
+  if(timing){
+    fflush(stdout);
+    mpi_timer_report(&tm, MPI_COMM_WORLD, stderr);
+    mpi_count_report(MPI_COMM_WORLD, stderr);
+  }
 
   //free the structures
-   if(proc_id == root_proc){
-     free(cur_ranks);//only exists on p0
+   if(shared != NULL){
+     pr_shared_free(shared);
+   }
+   else{
+     free(cur_ranks);
+     free(old_ranks);
+     free(indiv_cur_ranks);
+   }
+   free(prev_ranks);
+   free(prev2_ranks);
+   free(active);
+   csr_free(A);
+   if(pattern != NULL){
+     pattern_free(pattern);
    }
-   free(old_ranks);
-   free(indiv_cur_ranks);
-   free_densemat(mat);
-   free_densemat(scattermat);
+   free(outdeg);
+   free(order);
    free(counts);
-   free(countsmod);
    free(displs);
-   free(displsmod);
-   free(colsums);
     
   MPI_Finalize();
   return 0;
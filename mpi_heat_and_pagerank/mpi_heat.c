@@ -1,166 +1,403 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <mpi.h>
+#include <omp.h>
+#include <heat.h>
+#include <mpi_timer.h>
 
 #define NAME_LEN 255
+#define MG_MAX_CYCLES 100
 
-double calc_next(double posleft, double pos, double posright){
-  double left_diff, right_diff, delta;
-  double k = 0.5; //thermal conductivity constant
-  left_diff = pos - posleft;
-  right_diff = pos - posright;
-  delta = -k*(left_diff + right_diff);
-  return (pos + delta);
+// Phases reported by -timing
+enum { T_HALO, T_REDUCE, T_COMPUTE, T_GATHER, T_IO, T_STATS, T_TOTAL, T_NPHASES };
+static const char *phase_names[T_NPHASES] = {"halo", "reduce", "compute", "gather", "io", "stats",
+                                             "total"};
+
+// Put the fixed end temperatures into row wherever they fall among this
+// proc's owned and ghost cells
+static void set_ends(double *row, int halo, int nloc, int gstart, int width,
+                     double L_bound_temp, double R_bound_temp){
+  if(-gstart >= -halo){
+    row[-gstart] = L_bound_temp;
+  }
+  if(width-1-gstart < nloc+halo){
+    row[width-1-gstart] = R_bound_temp;
+  }
 }
+
 int main(int argc, char **argv){
   int npes, proc_id, name_len;
   char proc_name[NAME_LEN];
-  MPI_Init (&argc, &argv);                      /* starts MPI */
+  int provided;
+  MPI_Init_thread (&argc, &argv, MPI_THREAD_FUNNELED, &provided); /* starts MPI, only the master thread calls it */
   MPI_Comm_rank (MPI_COMM_WORLD, &proc_id);     /* get current process id */
   MPI_Comm_size (MPI_COMM_WORLD, &npes);        /* get number of processes */
   MPI_Get_processor_name(proc_name, &name_len); /* get the symbolic host name */
 
   if(argc < 4){
-    printf("usage: %s max_time width print\n max_time: int\n width: int\n print: 1 print output, 0 no printing\n",
-	    argv[0]);
+    printf("usage: %s max_time width print [-o results.bin] [-halo k] [-tile n] [-cn r] [-steady tol [-check n] [-mg]] [-timing] [-ckpt file [-ckpt_every n]] [-restart file] [-stats file.csv [-stats_every n] [-threshold T] [-nb]]\n max_time: int\n width: int\n print: 1 print output, 0 no printing\n -o: write all time steps to a binary file, see heat_reader\n -halo: exchange k ghost cells every k time steps (default 1)\n -tile: cells per cache tile when advancing k steps (default %d)\n -cn: implicit Crank-Nicolson steps, r is conductivity*dt/dx^2 (explicit steps are r = 0.5)\n -steady: stop once no cell changes by more than tol in a step\n -check: time steps between steady state checks (default 100)\n -mg: go straight to the steady state with multigrid, tol bounds the residual\n -timing: report the time spent in each phase to stderr, min/avg/max over processors\n -ckpt: save the rod to file every ckpt_every time steps (default 1000) and at the end\n -restart: carry on to max_time from the last row of a checkpoint or -o file, on any number of processors\n -stats: write min/max/mean temperature and the heat flux out of each end to a CSV file (- for stdout) as the run goes\n -stats_every: time steps between samples (default 1), samples fall at the end of each halo block\n -threshold: report the first sampled time step where the max temperature is at or below T\n -nb: overlap the statistics reductions with the time steps\n HEAT_NUMTHREADS: environment variable, threads per processor\n",
+	    argv[0], HEAT_TILE);
     return 0;
   }
-  
+
   int max_time = atoi(argv[1]); // Number of time steps to simulate
   int width = atoi(argv[2]);    // Number of cells in the rod
   int print = atoi(argv[3]);    // print option
-  double initial_temp = 50.0;   // Initial temp of internal cells 
+  char *outfile = NULL;         // binary output file, written with MPI-IO
+  int halo = 1;                 // ghost cells swapped with each neighbour, also the steps between swaps
+  int tile = HEAT_TILE;         // cells per cache tile
+  double cn_r = 0.0;            // Crank-Nicolson step size, 0 for explicit steps
+  heat_cn_t *cn = NULL;
+  double steady_tol = 0.0;      // largest change per step that counts as steady, 0 runs all max_time steps
+  int check = 100;              // time steps between steady state checks
+  int use_mg = 0;               // solve for the steady state with multigrid instead of stepping
+  int timing = 0;               // report per phase times
+  mpi_timer_t tm;
+  char *ckptfile = NULL;        // checkpoint file, rewritten every ckpt_every steps
+  int ckpt_every = 1000;
+  char *restartfile = NULL;     // checkpoint or result file to pick up from
+  heat_header_t rhdr;           // its header
+  MPI_File rfh;
+  char *statsfile = NULL;       // in-situ statistics, CSV
+  int stats_every = 1;
+  int stats_nb = 0;             // non-blocking reductions for the statistics
+  double threshold = -HUGE_VAL;
+  heat_stats_t *st = NULL;
+  int t0 = 0;                   // time step of H[0], later than 0 when restarting
+  int nt;                       // rows from t0 through max_time-1
+  double initial_temp = 50.0;   // Initial temp of internal cells
   double L_bound_temp = 20.0;   // Constant temp at Left end of rod
   double R_bound_temp = 10.0;   // Constant temp at Right end of rod
-  double **H;                   // 2D array of temps at times/locations 
-  double **root_data;           // To store the final data on proc0
-  double left_val, right_val;   // used for communication of left and right node values
+  double *H_all = NULL;         // All temps for this proc, one contiguous block
+  double **H;                   // 2D array of temps at times/locations
+  double *root_all;             // To store the final data on proc0
   int rootproc = 0;             // 0 is the root processor
-  int indiv_width = width/npes; // To determine how many columns each extra processor gets
-  int internal = indiv_width-2; // to determine how many cols dont deal with edge data
-  int t,p;
-  
-  H = malloc(sizeof(double*)*max_time); 
-  for(t=0;t<max_time;t++){
-     H[t] = malloc(sizeof(double*)*indiv_width);
-  }
-  t = 0;
-  for(p=0; p<indiv_width; p++){//we dont care about last columns, deal with that in calculation step
-    H[t][p] = initial_temp;    //initialize to initial temperature
-  }
-  
-  // Simulate the temperature changes for internal cells
-  for(t=0; t<max_time-1; t++){
-    //ESTABLISH COMMUNICATION AND TRANSFERS
-    if(npes > 1){//communication only happens when we have more than one processor
-      if(proc_id == rootproc){//even root
-	MPI_Send(&H[t][indiv_width-1], 1, MPI_DOUBLE, proc_id+1, 1, MPI_COMM_WORLD);
-	MPI_Recv(&right_val, 1, MPI_DOUBLE, proc_id+1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-      }
-      else if(proc_id == npes-1 && proc_id % 2 == 0){//even last
-	MPI_Recv(&left_val, 1, MPI_DOUBLE, proc_id-1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-	MPI_Send(&H[t][0], 1, MPI_DOUBLE, proc_id-1, 1, MPI_COMM_WORLD);
-      }
-      else if(proc_id == npes-1 && proc_id % 2 == 1){//odd last
-	MPI_Recv(&left_val, 1, MPI_DOUBLE, proc_id-1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-	MPI_Send(&H[t][0], 1, MPI_DOUBLE, proc_id-1, 1, MPI_COMM_WORLD);
-      }
-      else if(proc_id % 2 == 0){//even middle
-	MPI_Send(&H[t][indiv_width-1], 1, MPI_DOUBLE, proc_id+1, 1, MPI_COMM_WORLD);
-	MPI_Recv(&right_val, 1, MPI_DOUBLE, proc_id+1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-	MPI_Recv(&left_val, 1, MPI_DOUBLE, proc_id-1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-	MPI_Send(&H[t][0], 1, MPI_DOUBLE, proc_id-1, 1, MPI_COMM_WORLD);
+  int indiv_width;              // columns this proc owns, the first width%npes procs get an extra one
+  int gstart;                   // position on the rod of this proc's first column
+  int min_width;                // fewest columns any proc owns
+  int left = (proc_id > 0) ? proc_id-1 : MPI_PROC_NULL;       // neighbours, PROC_NULL at the ends
+  int right = (proc_id < npes-1) ? proc_id+1 : MPI_PROC_NULL;
+  int *counts, *displs;         // columns owned by each proc and where they start
+  int lead, stride, nrows, nsteps;
+  int nout;                     // time steps actually taken, less than max_time if the rod went steady
+  int next_check, next_ckpt, next_stats;
+  int t,p,s,i;
+
+  for(p=4; p<argc; p++){//optional flags after the positional args
+    if(strcmp(argv[p],"-o") == 0 && p+1 < argc){
+      outfile = argv[++p];
+    }
+    else if(strcmp(argv[p],"-halo") == 0 && p+1 < argc){
+      halo = atoi(argv[++p]);
+    }
+    else if(strcmp(argv[p],"-tile") == 0 && p+1 < argc){
+      tile = atoi(argv[++p]);
+    }
+    else if(strcmp(argv[p],"-cn") == 0 && p+1 < argc){
+      cn_r = atof(argv[++p]);
+    }
+    else if(strcmp(argv[p],"-steady") == 0 && p+1 < argc){
+      steady_tol = atof(argv[++p]);
+    }
+    else if(strcmp(argv[p],"-check") == 0 && p+1 < argc){
+      check = atoi(argv[++p]);
+    }
+    else if(strcmp(argv[p],"-mg") == 0){
+      use_mg = 1;
+    }
+    else if(strcmp(argv[p],"-timing") == 0){
+      timing = 1;
+    }
+    else if(strcmp(argv[p],"-ckpt") == 0 && p+1 < argc){
+      ckptfile = argv[++p];
+    }
+    else if(strcmp(argv[p],"-ckpt_every") == 0 && p+1 < argc){
+      ckpt_every = atoi(argv[++p]);
+    }
+    else if(strcmp(argv[p],"-restart") == 0 && p+1 < argc){
+      restartfile = argv[++p];
+    }
+    else if(strcmp(argv[p],"-stats") == 0 && p+1 < argc){
+      statsfile = argv[++p];
+    }
+    else if(strcmp(argv[p],"-stats_every") == 0 && p+1 < argc){
+      stats_every = atoi(argv[++p]);
+    }
+    else if(strcmp(argv[p],"-threshold") == 0 && p+1 < argc){
+      threshold = atof(argv[++p]);
+    }
+    else if(strcmp(argv[p],"-nb") == 0){
+      stats_nb = 1;
+    }
+    else{
+      if(proc_id == rootproc){ printf("unknown option %s\n",argv[p]); }
+      MPI_Finalize();
+      return 0;
+    }
+  }
+  //check env variable for number of threads
+  char *nthreads_str = getenv("HEAT_NUMTHREADS");
+  if(nthreads_str != NULL){
+    omp_set_num_threads(atoi(nthreads_str));
+  }
+
+  if(restartfile != NULL){//the rod and its temperatures come from the file
+    rfh = heat_open_input(MPI_COMM_WORLD, restartfile, &rhdr);
+    if(rhdr.ndims != 1){
+      if(proc_id == rootproc){ printf("%s does not hold a 1D rod\n",restartfile); }
+      MPI_Finalize();
+      return 0;
+    }
+    if(rhdr.dims[0] != width && proc_id == rootproc){
+      fprintf(stderr,"%s holds a rod of width %d, using that\n",restartfile,rhdr.dims[0]);
+    }
+    width = rhdr.dims[0];
+    t0 = rhdr.first_step + rhdr.nsteps-1;
+    initial_temp = rhdr.initial_temp;
+    L_bound_temp = rhdr.L_bound_temp;
+    R_bound_temp = rhdr.R_bound_temp;
+  }
+  nt = max_time - t0;
+  if(nt < 1){
+    if(proc_id == rootproc){ printf("max_time %d leaves no time steps to run from time step %d\n",max_time,t0); }
+    MPI_Finalize();
+    return 0;
+  }
+  if(ckpt_every < 1){
+    ckpt_every = 1;
+  }
+  if(stats_every < 1){
+    stats_every = 1;
+  }
+
+  if(width < npes){
+    if(proc_id == rootproc){ printf("width %d must be at least the number of processors %d\n",width,npes); }
+    MPI_Finalize();
+    return 0;
+  }
+  counts = malloc(npes * sizeof(int));
+  displs = malloc(npes * sizeof(int));
+  for(i=0; i<npes; i++){
+    counts[i] = heat_partition(width, npes, i, &displs[i]);
+  }
+  indiv_width = counts[proc_id];
+  gstart = displs[proc_id];
+  min_width = counts[npes-1];
+
+  if(halo < 1 || cn_r > 0.0){//implicit steps only need the neighbours' edge cells
+    halo = 1;
+  }
+  if(cn_r > 0.0){
+    cn = heat_cn_setup(cn_r, indiv_width, gstart, width, MPI_COMM_WORLD);
+    if(cn == NULL){
+      if(proc_id == rootproc){ printf("-cn needs every processor to own a cell that is not an end of the rod\n"); }
+      MPI_Finalize();
+      return 0;
+    }
+  }
+  if(halo > min_width){//neighbours can only send the cells they own
+    if(proc_id == rootproc){
+      fprintf(stderr,"halo %d is wider than the %d cells per processor, using %d\n",halo,min_width,min_width);
+    }
+    halo = min_width;
+  }
+
+  //each row has halo ghost cells on both sides, H[t] points at the
+  //first owned cell so H[t][-1] is the left ghost. Rows are carved out
+  //of one block so the whole history can be written at once. When
+  //nothing is output only two rows are kept and H[t] alternates
+  //between them. The left ghosts are padded out so every row's first
+  //owned cell starts on a HEAT_ALIGN boundary.
+  lead = (halo + HEAT_ALIGN_DOUBLES-1) / HEAT_ALIGN_DOUBLES * HEAT_ALIGN_DOUBLES;
+  stride = (lead + indiv_width + halo + HEAT_ALIGN_DOUBLES-1) / HEAT_ALIGN_DOUBLES * HEAT_ALIGN_DOUBLES;
+  nrows = (print == 1 || outfile != NULL) ? nt : 2;
+  if(posix_memalign((void **) &H_all, HEAT_ALIGN, sizeof(double)*nrows*stride) != 0){
+    fprintf(stderr,"ERROR: could not allocate %d rows of %d cells\n",nrows,stride);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  H = malloc(sizeof(double*)*nt);
+  for(t=0;t<nt;t++){
+     H[t] = &H_all[(t%nrows)*stride + lead];
+  }
+  for(p=-halo; p<indiv_width+halo; p++){
+    H[0][p] = initial_temp;    //initialize to initial temperature
+  }
+  if(restartfile != NULL){
+    heat_read_rod_row(rfh, &rhdr, rhdr.nsteps-1, H[0], indiv_width, gstart);
+    MPI_File_close(&rfh);
+  }
+
+  mpi_timer_init(&tm, timing, T_NPHASES, phase_names);
+  MPI_Barrier(MPI_COMM_WORLD);  // start everyone's clocks together
+  mpi_timer_start(&tm, T_TOTAL);
+  if(statsfile != NULL){
+    st = heat_stats_open(MPI_COMM_WORLD, statsfile, stats_nb, (cn != NULL) ? cn_r : 0.5, threshold);
+  }
+  if(use_mg){//only the final profile, as a single row
+    double resid;
+    int cycles;
+    mpi_timer_start(&tm, T_COMPUTE);
+    set_ends(H[0], halo, indiv_width, gstart, width, L_bound_temp, R_bound_temp);
+    cycles = heat_mg_steady(H[0], indiv_width, gstart, width,
+                            (steady_tol > 0.0) ? steady_tol : 1e-6, MG_MAX_CYCLES,
+                            MPI_COMM_WORLD, &resid);
+    if(proc_id == rootproc){
+      fprintf(stderr,"multigrid: %d V-cycles, residual %.2e\n",cycles,resid);
+    }
+    nout = 1;
+    mpi_timer_stop(&tm, T_COMPUTE);
+    if(st != NULL){
+      heat_stats_step(st, t0, H[0], indiv_width, gstart, width);
+    }
+  }
+  else{
+    // Simulate the temperature changes for internal cells, halo steps at
+    // a time. Every proc recomputes the cells its ghosts cover so it only
+    // needs to hear from its neighbours once per block. Implicit steps
+    // are taken one at a time. In steady state mode the largest change
+    // over the last step of a block is checked about every check steps
+    // and the run stops once every proc is below steady_tol.
+    nout = nt;
+    next_check = check;
+    next_ckpt = ckpt_every;
+    next_stats = stats_every;
+    if(st != NULL){//the ends are fixed from the start, sample them too
+      set_ends(H[0], halo, indiv_width, gstart, width, L_bound_temp, R_bound_temp);
+      mpi_timer_start(&tm, T_STATS);
+      heat_stats_step(st, t0, H[0], indiv_width, gstart, width);
+      mpi_timer_stop(&tm, T_STATS);
+    }
+    for(t=0; t<nt-1; t+=nsteps){
+      nsteps = (nt-1-t < halo) ? nt-1-t : halo;
+      mpi_timer_start(&tm, T_HALO);
+      heat_exchange_halo(H[t], indiv_width, halo, left, right, MPI_COMM_WORLD);
+      mpi_timer_stop(&tm, T_HALO);
+      mpi_timer_start(&tm, T_COMPUTE);
+      for(s=0; s<=nsteps; s++){//the static end columns, wherever they fall in this proc's row
+        set_ends(H[t+s], halo, indiv_width, gstart, width, L_bound_temp, R_bound_temp);
       }
-      else if(proc_id % 2 == 1){//odd middle
-	MPI_Recv(&left_val, 1, MPI_DOUBLE, proc_id-1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-	MPI_Send(&H[t][0], 1, MPI_DOUBLE, proc_id-1, 1, MPI_COMM_WORLD);
-	MPI_Send(&H[t][indiv_width-1], 1, MPI_DOUBLE, proc_id+1, 1, MPI_COMM_WORLD);
-	MPI_Recv(&right_val, 1, MPI_DOUBLE, proc_id+1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      if(cn != NULL){
+        heat_cn_step(cn, H[t+1], H[t], L_bound_temp, R_bound_temp);
       }
-      else{ printf("couldnt find a processor for communications"); }
-    }
- 
-    //PERFORM THE NECESSARY CALCULATIONS    
-    if(proc_id == rootproc){//do root
-      H[t][0] = L_bound_temp; //fill in left static col
-      if(npes < 2){ //in the case we only had one processor working
-	H[t][indiv_width-1] = R_bound_temp; //fill in right static col
+      else{
+        heat_advance_block(&H[t], nsteps, 1-halo, indiv_width+halo-1,
+                           1-gstart, width-1-gstart, tile);
       }
-      //internal is up to indiv_width-2, so 3 cols then 3-2 = 1 internal col
-      for(p=1; p<=internal; p++){//0 is the static temp col
-	H[t+1][p] = calc_next( H[t][p-1], H[t][p], H[t][p+1] );
-      }      
-      H[t+1][indiv_width-1] = calc_next( H[t][indiv_width-2], H[t][indiv_width-1], right_val );//handle the right most column using communicated data
-      if(t==max_time-2){//set the last static right col (bottom left)
-	H[t+1][0] = L_bound_temp;
-	if(npes < 2){ //in the case we only had one processor working (static col bottom right)
-	  H[t+1][indiv_width-1] = R_bound_temp;
-	}
+      mpi_timer_stop(&tm, T_COMPUTE);
+      if(st != NULL && t+nsteps >= next_stats){
+        mpi_timer_start(&tm, T_STATS);
+        heat_stats_step(st, t0+t+nsteps, H[t+nsteps], indiv_width, gstart, width);
+        mpi_timer_stop(&tm, T_STATS);
+        next_stats = t+nsteps + stats_every;
       }
-    }
-    else if((proc_id > 0) && (proc_id < npes-1)){//do internal proc calculations
-      H[t+1][0] = calc_next( left_val, H[t][0] , H[t][1]);//handle value communicated from the left  
-      for(p=1; p<indiv_width-1; p++){//handle middle values requiring no externals
-	H[t+1][p] = calc_next( H[t][p-1], H[t][p], H[t][p+1] );
+      if(ckptfile != NULL && t+nsteps >= next_ckpt){
+        heat_header_t hdr;
+        mpi_timer_start(&tm, T_IO);
+        heat_header_init(&hdr, 1, &width, 1, t0+t+nsteps,
+                         initial_temp, L_bound_temp, R_bound_temp, (cn != NULL) ? cn_r : 0.5);
+        heat_write_checkpoint(MPI_COMM_WORLD, ckptfile, &hdr, H[t+nsteps], indiv_width, gstart);
+        mpi_timer_stop(&tm, T_IO);
+        next_ckpt = t+nsteps + ckpt_every;
       }
-      H[t+1][indiv_width-1] = calc_next( H[t][indiv_width-2], H[t][indiv_width-1], right_val );//handle value communicated from the right
-    }
-    else if(proc_id == npes-1 && npes > 1){//do last, this is only needed when there are multiple processors.
-      H[t][indiv_width-1] = R_bound_temp;//set last static column
-      H[t+1][0] = calc_next( left_val, H[t][0], H[t][1] );//handle value communicated from the left
-      for(p=1; p<=internal; p++){//handle values up to static column
-	H[t+1][p] = calc_next( H[t][p-1], H[t][p], H[t][p+1] );
-      } 
-      if(t==max_time-2){//set the last static right col (bottom right)
-	H[t+1][indiv_width-1] = R_bound_temp;
+      if(steady_tol > 0.0 && t+nsteps >= next_check){
+        double change = 0.0, most;
+        mpi_timer_start(&tm, T_COMPUTE);
+        for(p=0; p<indiv_width; p++){
+          change = fmax(change, fabs(H[t+nsteps][p] - H[t+nsteps-1][p]));
+        }
+        mpi_timer_stop(&tm, T_COMPUTE);
+        mpi_timer_start(&tm, T_REDUCE);
+        MPI_Allreduce(&change, &most, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        mpi_timer_stop(&tm, T_REDUCE);
+        next_check = t+nsteps + check;
+        if(most < steady_tol){
+          nout = t+nsteps+1;
+          if(proc_id == rootproc){
+            fprintf(stderr,"steady after %d time steps, largest change %.2e\n",t0+t+nsteps,most);
+          }
+          break;
+        }
       }
     }
-    else{ printf("couldnt find a processor for calculations"); }
   }
-  //begin gather procedure
-  if(proc_id == rootproc){//make space for root_data array
-    root_data = malloc(sizeof(double*)*max_time);
-    for(t=0;t<max_time;t++){
-       root_data[t] = malloc(sizeof(double*)*width);
-    }
+
+  if(st != NULL){
+    mpi_timer_start(&tm, T_STATS);
+    heat_stats_close(st);
+    mpi_timer_stop(&tm, T_STATS);
   }
-  for(t=0; t<max_time; t++){//gather the data to root
-     MPI_Gather(H[t], indiv_width, MPI_DOUBLE,
-		root_data[t],indiv_width, MPI_DOUBLE,
-		rootproc, MPI_COMM_WORLD);
+  if(ckptfile != NULL){//the final state, so a later run can carry on from it
+    heat_header_t hdr;
+    mpi_timer_start(&tm, T_IO);
+    heat_header_init(&hdr, 1, &width, 1, t0+nout-1,
+                     initial_temp, L_bound_temp, R_bound_temp, (cn != NULL) ? cn_r : 0.5);
+    heat_write_checkpoint(MPI_COMM_WORLD, ckptfile, &hdr, H[nout-1], indiv_width, gstart);
+    mpi_timer_stop(&tm, T_IO);
+  }
+  if(outfile != NULL){//every proc writes its slice of every row in one collective
+    heat_header_t hdr;
+    mpi_timer_start(&tm, T_IO);
+    heat_header_init(&hdr, 1, &width, nout, t0,
+                     initial_temp, L_bound_temp, R_bound_temp, (cn != NULL) ? cn_r : 0.5);
+    MPI_File fh = heat_open_output(MPI_COMM_WORLD, outfile, &hdr);
+    heat_write_rod(fh, H[0], nout, stride, indiv_width, gstart, width);
+    MPI_File_close(&fh);
+    mpi_timer_stop(&tm, T_IO);
   }
-  //end gather procedure
-  free(H);//everyone free H
   if(print == 1){
+    //gather every proc's whole history in one call, root_all holds
+    //npes blocks of nout x counts[i] which get stitched back
+    //together a row at a time for printing
+    int *hist_counts = malloc(npes * sizeof(int));
+    int *hist_displs = malloc(npes * sizeof(int));
+    for(i=0; i<npes; i++){
+      hist_counts[i] = nout*counts[i];
+      hist_displs[i] = nout*displs[i];
+    }
+    MPI_Datatype owned;         // the owned cells of every row, skipping ghosts
+    mpi_timer_start(&tm, T_GATHER);
+    MPI_Type_vector(nout, indiv_width, stride, MPI_DOUBLE, &owned);
+    MPI_Type_commit(&owned);
+    root_all = NULL;
+    if(proc_id == rootproc){//make space for root_data array
+      root_all = malloc(sizeof(double)*nout*width);
+    }
+    MPI_Gatherv(H[0], 1, owned,
+		root_all, hist_counts, hist_displs, MPI_DOUBLE,
+		rootproc, MPI_COMM_WORLD);
+    MPI_Type_free(&owned);
+    mpi_timer_stop(&tm, T_GATHER);
     if(proc_id == rootproc){//start proc0 printing
+      mpi_timer_start(&tm, T_IO);
+      double *row = malloc(sizeof(double)*width);
       // Print results
-      printf("Temperature results for 1D rod\n");
-      printf("Time step increases going down rows\n");
-      printf("Position on rod changes going accross columns\n");
-      // Column headers
-      printf("%3s| ","");
-      for(p=0; p<width; p++){
-	printf("%5d ",p);
-      }
-      printf("\n");
-      printf("%3s+-","---");
-      for(p=0; p<width; p++){
-	printf("------");
-      }
-      printf("\n");
+      heat_print_table_header(stdout, width);
       // Row headers and data
-      for(t=0; t<max_time; t++){
-	printf("%3d| ",t);
-	for(p=0; p<width; p++){
-	  // printf("%5.1f ",H[t][p]);
-	  printf("%5.1f ",root_data[t][p]);
+      for(t=0; t<nout; t++){
+	for(i=0; i<npes; i++){
+	  memcpy(&row[displs[i]], &root_all[hist_displs[i] + t*counts[i]],
+		 sizeof(double)*counts[i]);
 	}
-	printf("\n");
+	heat_print_table_row(stdout, t0+t, row, width);
       }
-      free(root_data);//free the root_data array
+      free(row);
+      free(root_all);//free the root_data array
+      mpi_timer_stop(&tm, T_IO);
     }//end proc0 printing
+    free(hist_counts);
+    free(hist_displs);
   }
+  mpi_timer_stop(&tm, T_TOTAL);
+  mpi_timer_report(&tm, MPI_COMM_WORLD, stderr);
+  if(cn != NULL){
+    heat_cn_free(cn);
+  }
+  free(counts);
+  free(displs);
+  free(H);//everyone free H
+  free(H_all);
   MPI_Finalize();
   return 0;
 }
-      
@@ -0,0 +1,206 @@
+// Many independent rods in one run, for parameter sweeps. Each member
+// of the ensemble has its own conductivity, initial temperature and end
+// temperatures, read from a file, but they all share the rod's width
+// and its split across processors.
+//
+// Members are interleaved cell by cell: the m members' copies of cell p
+// sit side by side at row[p*m .. p*m+m-1]. The inner loop of the
+// stencil runs across members, so one vector instruction updates the
+// same cell of several rods, and a halo of one cell is a single message
+// of m doubles carrying every member's ghost cell.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include <omp.h>
+#include <heat.h>
+
+#define NAME_LEN 255
+#define LINE_LEN 1024
+
+// One explicit step of every member over cells [from,to) of the rod
+static void advance(double *restrict next, const double *restrict cur, const double *restrict k,
+                    int m, int from, int to){
+  int p,j;
+#pragma omp parallel for private(j) schedule(static) if(to-from > HEAT_TILE)
+  for(p=from; p<to; p++){
+    const double *c = &cur[p*m];
+    double *n = &next[p*m];
+#pragma omp simd
+    for(j=0; j<m; j++){
+      n[j] = c[j] - k[j]*((c[j] - c[j-m]) + (c[j] - c[j+m]));
+    }
+  }
+}
+
+// Read the members from fname on the root, one per line as
+//   k initial_temp L_bound_temp R_bound_temp
+// skipping blank lines and lines starting with #. params gets 4 doubles
+// per member. Returns the number of members, 0 if the file could not be
+// read.
+static int read_members(char *fname, double **params){
+  FILE *f = fopen(fname,"r");
+  char line[LINE_LEN];
+  int m = 0, size = 16;
+  double *par;
+  if(f == NULL){
+    perror(fname);
+    return 0;
+  }
+  par = malloc(4*size*sizeof(double));
+  while(fgets(line, LINE_LEN, f) != NULL){
+    if(line[0] == '#'){
+      continue;
+    }
+    if(m == size){
+      size *= 2;
+      par = realloc(par, 4*size*sizeof(double));
+    }
+    if(sscanf(line, "%lf %lf %lf %lf", &par[4*m], &par[4*m+1], &par[4*m+2], &par[4*m+3]) == 4){
+      m++;
+    }
+  }
+  fclose(f);
+  *params = par;
+  return m;
+}
+
+int main(int argc, char **argv){
+  int npes, proc_id, name_len;
+  char proc_name[NAME_LEN];
+  int provided;
+  MPI_Init_thread (&argc, &argv, MPI_THREAD_FUNNELED, &provided); /* starts MPI, only the master thread calls it */
+  MPI_Comm_rank (MPI_COMM_WORLD, &proc_id);     /* get current process id */
+  MPI_Comm_size (MPI_COMM_WORLD, &npes);        /* get number of processes */
+  MPI_Get_processor_name(proc_name, &name_len); /* get the symbolic host name */
+
+  if(argc < 5){
+    printf("usage: %s max_time width print members.txt\n max_time: int\n width: int\n print: 1 print the final temperatures of every member, 0 no printing\n members.txt: one rod per line, k initial_temp L_bound_temp R_bound_temp\n HEAT_NUMTHREADS: environment variable, threads per processor\n",
+	   argv[0]);
+    return 0;
+  }
+
+  int max_time = atoi(argv[1]); // Number of time steps to simulate
+  int width = atoi(argv[2]);    // Number of cells in every rod
+  int print = atoi(argv[3]);    // print option
+  char *memberfile = argv[4];
+  int m = 0;                    // members in the ensemble
+  double *params = NULL;        // k, initial, left and right temps of each member
+  double *k;                    // conductivity of each member
+  double *cur_all = NULL, *next_all = NULL, *cur, *next, *tmp;
+  int rootproc = 0;             // 0 is the root processor
+  int indiv_width, gstart;      // cells this proc owns and where they start
+  int left = (proc_id > 0) ? proc_id-1 : MPI_PROC_NULL;       // neighbours, PROC_NULL at the ends
+  int right = (proc_id < npes-1) ? proc_id+1 : MPI_PROC_NULL;
+  int lead, stride, from, to;
+  int t,p,j;
+
+  //check env variable for number of threads
+  char *nthreads_str = getenv("HEAT_NUMTHREADS");
+  if(nthreads_str != NULL){
+    omp_set_num_threads(atoi(nthreads_str));
+  }
+
+  if(proc_id == rootproc){
+    m = read_members(memberfile, &params);
+  }
+  MPI_Bcast(&m, 1, MPI_INT, rootproc, MPI_COMM_WORLD);
+  if(m == 0){
+    if(proc_id == rootproc){ printf("no members in %s\n",memberfile); }
+    MPI_Finalize();
+    return 0;
+  }
+  if(proc_id != rootproc){
+    params = malloc(4*m*sizeof(double));
+  }
+  MPI_Bcast(params, 4*m, MPI_DOUBLE, rootproc, MPI_COMM_WORLD);
+
+  if(width < npes){
+    if(proc_id == rootproc){ printf("width %d must be at least the number of processors %d\n",width,npes); }
+    MPI_Finalize();
+    return 0;
+  }
+  indiv_width = heat_partition(width, npes, proc_id, &gstart);
+
+  //rows hold one ghost cell, m doubles, on each side and are padded so
+  //the first owned cell starts on a HEAT_ALIGN boundary
+  lead = (m + HEAT_ALIGN_DOUBLES-1) / HEAT_ALIGN_DOUBLES * HEAT_ALIGN_DOUBLES;
+  stride = lead + (indiv_width+1)*m;
+  if(posix_memalign((void **) &cur_all, HEAT_ALIGN, sizeof(double)*stride) != 0 ||
+     posix_memalign((void **) &next_all, HEAT_ALIGN, sizeof(double)*stride) != 0){
+    fprintf(stderr,"ERROR: could not allocate %d members of %d cells\n",m,indiv_width);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  cur = &cur_all[lead];
+  next = &next_all[lead];
+  k = malloc(m*sizeof(double));
+  for(j=0; j<m; j++){
+    k[j] = params[4*j];
+  }
+  for(p=-1; p<=indiv_width; p++){
+    for(j=0; j<m; j++){
+      cur[p*m+j] = params[4*j+1];
+    }
+  }
+  for(j=0; j<m; j++){//the static ends are never recomputed, set them in both rows
+    if(gstart == 0){
+      cur[j] = next[j] = params[4*j+2];
+    }
+    if(gstart+indiv_width == width){
+      cur[(indiv_width-1)*m+j] = next[(indiv_width-1)*m+j] = params[4*j+3];
+    }
+  }
+  from = (gstart == 0) ? 1 : 0;
+  to = (gstart+indiv_width == width) ? indiv_width-1 : indiv_width;
+
+  for(t=0; t<max_time-1; t++){
+    heat_exchange_halo(cur, indiv_width*m, m, left, right, MPI_COMM_WORLD);
+    advance(next, cur, k, m, from, to);
+    tmp = cur;
+    cur = next;
+    next = tmp;
+  }
+
+  if(print == 1){
+    //every proc's block of interleaved cells lands in place on the root,
+    //which pulls each member back out for printing
+    int *counts = malloc(npes * sizeof(int));
+    int *displs = malloc(npes * sizeof(int));
+    double *all = NULL, *row = NULL;
+    for(p=0; p<npes; p++){
+      counts[p] = m*heat_partition(width, npes, p, &displs[p]);
+      displs[p] *= m;
+    }
+    if(proc_id == rootproc){
+      all = malloc(sizeof(double)*width*m);
+      row = malloc(sizeof(double)*width);
+    }
+    MPI_Gatherv(cur, indiv_width*m, MPI_DOUBLE,
+                all, counts, displs, MPI_DOUBLE, rootproc, MPI_COMM_WORLD);
+    if(proc_id == rootproc){
+      for(j=0; j<m; j++){
+        printf("Member %d: k %g initial_temp %g L_bound_temp %g R_bound_temp %g\n",
+               j,params[4*j],params[4*j+1],params[4*j+2],params[4*j+3]);
+      }
+      heat_print_ensemble_header(stdout, max_time-1, width);
+      for(j=0; j<m; j++){
+        for(p=0; p<width; p++){
+          row[p] = all[p*m+j];
+        }
+        heat_print_table_row(stdout, j, row, width);
+      }
+      free(all);
+      free(row);
+    }
+    free(counts);
+    free(displs);
+  }
+
+  free(params);
+  free(k);
+  free(cur_all);
+  free(next_all);
+  MPI_Finalize();
+  return 0;
+}
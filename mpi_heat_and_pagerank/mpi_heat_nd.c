@@ -0,0 +1,299 @@
+// Heat diffusion on a 2D plate or 3D block. Processors are laid out on
+// a Cartesian grid and each owns a nearly equal box of cells with one
+// layer of ghost cells around it. The left (x = 0) face is held at
+// L_bound_temp and the right (x = nx-1) face at R_bound_temp as with
+// the rod; the other faces are insulated.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include <omp.h>
+#include <heat.h>
+
+#define NAME_LEN 255
+
+// Local arrays are always indexed [z][y][x]. A plate has a single z
+// layer with no ghosts around it so zoff is 0; a block has zoff 1.
+typedef struct {
+  int ndims;
+  int zoff;
+  int asz[3];                   // local array size including ghosts, z y x
+  int lsz[3];                   // owned cells, z y x
+  int gst[3];                   // global index of the first owned cell, z y x
+  int gsz[3];                   // global size, z y x
+  int stride[3];                // distance between neighbours in each dim
+  int lo_nbr[3], hi_nbr[3];     // neighbour ranks, MPI_PROC_NULL at the edges
+  MPI_Datatype face[3];         // one owned plane perpendicular to each dim
+} box_t;
+
+// Index of owned cell (z,y,x) counting from the first owned cell
+#define IDX(b,z,y,x) (((z)+(b)->zoff)*(b)->stride[0] + ((y)+1)*(b)->stride[1] + ((x)+1))
+
+// Swap a layer of ghost cells with the neighbours in every dimension.
+// Faces are not contiguous in memory so each is described by a
+// subarray type and sent straight out of the array.
+static void exchange_faces(box_t *b, double *u, MPI_Comm cart){
+  int d;
+  for(d=3-b->ndims; d<3; d++){
+    int off = (d == 0) ? b->zoff : 1;
+    double *lo_owned = &u[off*b->stride[d]];
+    double *hi_owned = &u[(off+b->lsz[d]-1)*b->stride[d]];
+    double *lo_ghost = &u[(off-1)*b->stride[d]];
+    double *hi_ghost = &u[(off+b->lsz[d])*b->stride[d]];
+    MPI_Sendrecv(hi_owned, 1, b->face[d], b->hi_nbr[d], 1,
+                 lo_ghost, 1, b->face[d], b->lo_nbr[d], 1,
+                 cart, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(lo_owned, 1, b->face[d], b->lo_nbr[d], 2,
+                 hi_ghost, 1, b->face[d], b->hi_nbr[d], 2,
+                 cart, MPI_STATUS_IGNORE);
+  }
+}
+
+// Insulated faces: the ghost plane on the outside of the grid copies
+// the owned plane next to it so no heat flows across
+static void mirror_faces(box_t *b, double *u){
+  int z,y,x;
+  for(z=0; z<b->lsz[0]; z++){
+    for(x=0; x<b->lsz[2]; x++){
+      if(b->lo_nbr[1] == MPI_PROC_NULL){
+        u[IDX(b,z,-1,x)] = u[IDX(b,z,0,x)];
+      }
+      if(b->hi_nbr[1] == MPI_PROC_NULL){
+        u[IDX(b,z,b->lsz[1],x)] = u[IDX(b,z,b->lsz[1]-1,x)];
+      }
+    }
+  }
+  if(b->ndims == 3){
+    for(y=0; y<b->lsz[1]; y++){
+      for(x=0; x<b->lsz[2]; x++){
+        if(b->lo_nbr[0] == MPI_PROC_NULL){
+          u[IDX(b,-1,y,x)] = u[IDX(b,0,y,x)];
+        }
+        if(b->hi_nbr[0] == MPI_PROC_NULL){
+          u[IDX(b,b->lsz[0],y,x)] = u[IDX(b,b->lsz[0]-1,y,x)];
+        }
+      }
+    }
+  }
+}
+
+// One time step over the owned cells, skipping the fixed x faces.
+// Threads split the x rows between them and each row is vectorized.
+static void advance(box_t *b, double *restrict next, const double *restrict cur){
+  int z,y,x,i;
+  int xlo = (b->gst[2] == 0) ? 1 : 0;
+  int xhi = (b->gst[2]+b->lsz[2] == b->gsz[2]) ? b->lsz[2]-1 : b->lsz[2];
+  int sy = b->stride[1], sz = b->stride[0];
+#pragma omp parallel for collapse(2) private(x,i) schedule(static)
+  for(z=0; z<b->lsz[0]; z++){
+    for(y=0; y<b->lsz[1]; y++){
+      i = IDX(b,z,y,0);
+      if(b->ndims == 2){
+#pragma omp simd
+        for(x=xlo; x<xhi; x++){
+          next[i+x] = calc_next5(cur[i+x], cur[i+x-1], cur[i+x+1], cur[i+x-sy], cur[i+x+sy]);
+        }
+      }
+      else{
+#pragma omp simd
+        for(x=xlo; x<xhi; x++){
+          next[i+x] = calc_next7(cur[i+x], cur[i+x-1], cur[i+x+1], cur[i+x-sy], cur[i+x+sy],
+                                 cur[i+x-sz], cur[i+x+sz]);
+        }
+      }
+    }
+  }
+}
+
+// Work out the box of cells owned by the processor at coords of a
+// Cartesian grid with pdims processors in each dim
+static void find_box(int ndims, int *gsz, int *pdims, int *coords, int *lsz, int *gst){
+  int d, cd;
+  for(d=0; d<3; d++){
+    lsz[d] = gsz[d];
+    gst[d] = 0;
+  }
+  for(cd=0; cd<ndims; cd++){
+    d = cd + 3 - ndims;
+    lsz[d] = heat_partition(gsz[d], pdims[cd], coords[cd], &gst[d]);
+  }
+}
+
+int main(int argc, char **argv){
+  int npes, proc_id, name_len;
+  char proc_name[NAME_LEN];
+  int provided;
+  MPI_Init_thread (&argc, &argv, MPI_THREAD_FUNNELED, &provided); /* starts MPI, only the master thread calls it */
+  MPI_Comm_rank (MPI_COMM_WORLD, &proc_id);     /* get current process id */
+  MPI_Comm_size (MPI_COMM_WORLD, &npes);        /* get number of processes */
+  MPI_Get_processor_name(proc_name, &name_len); /* get the symbolic host name */
+
+  if(argc < 5){
+    printf("usage: %s max_time print nx ny [nz] [-o final.bin]\n max_time: int\n print: 1 print the final temperatures, 0 no printing\n nx ny: plate size, add nz for a block\n -o: write the final temperatures to a binary file, see heat_reader\n HEAT_NUMTHREADS: environment variable, threads per processor\n",
+	    argv[0]);
+    return 0;
+  }
+
+  int max_time = atoi(argv[1]); // Number of time steps to simulate
+  int print = atoi(argv[2]);    // print option
+  int n[3] = {1, 1, 1};         // cells in x, y, z
+  char *outfile = NULL;         // binary output file, written with MPI-IO
+  double initial_temp = 50.0;   // Initial temp of internal cells
+  double L_bound_temp = 20.0;   // Constant temp at Left face
+  double R_bound_temp = 10.0;   // Constant temp at Right face
+  int rootproc = 0;             // 0 is the root processor
+  int ndims = 0;
+  int pdims[3] = {0, 0, 0};     // processors in each dim of the grid
+  int periods[3] = {0, 0, 0};
+  int coords[3];
+  int cart_id;
+  MPI_Comm cart;
+  box_t box, *b = &box;
+  double *cur, *next, *tmp;
+  int t,p,d,z,y,x,ncells;
+
+  //check env variable for number of threads
+  char *nthreads_str = getenv("HEAT_NUMTHREADS");
+  if(nthreads_str != NULL){
+    omp_set_num_threads(atoi(nthreads_str));
+  }
+
+  for(p=3; p<argc; p++){
+    if(strcmp(argv[p],"-o") == 0 && p+1 < argc){
+      outfile = argv[++p];
+    }
+    else if(argv[p][0] != '-' && ndims < 3){
+      n[ndims++] = atoi(argv[p]);
+    }
+    else{
+      if(proc_id == rootproc){ printf("unknown option %s\n",argv[p]); }
+      MPI_Finalize();
+      return 0;
+    }
+  }
+  if(ndims < 2){
+    if(proc_id == rootproc){ printf("need at least nx and ny\n"); }
+    MPI_Finalize();
+    return 0;
+  }
+
+  // Lay the processors out on a grid, letting MPI reorder ranks to
+  // match the machine. Sizes are in C order: z y x.
+  b->ndims = ndims;
+  b->zoff = (ndims == 3) ? 1 : 0;
+  b->gsz[0] = n[2];
+  b->gsz[1] = n[1];
+  b->gsz[2] = n[0];
+  MPI_Dims_create(npes, ndims, pdims);
+  MPI_Cart_create(MPI_COMM_WORLD, ndims, pdims, periods, 1, &cart);
+  MPI_Comm_rank(cart, &cart_id);
+  MPI_Cart_coords(cart, cart_id, ndims, coords);
+  for(d=0; d<ndims; d++){
+    if(b->gsz[d+3-ndims] < pdims[d]){
+      if(cart_id == rootproc){
+        printf("grid of %d cells cannot be split over %d processors\n",b->gsz[d+3-ndims],pdims[d]);
+      }
+      MPI_Finalize();
+      return 0;
+    }
+  }
+  find_box(ndims, b->gsz, pdims, coords, b->lsz, b->gst);
+  b->asz[0] = b->lsz[0] + 2*b->zoff;
+  b->asz[1] = b->lsz[1] + 2;
+  b->asz[2] = b->lsz[2] + 2;
+  b->stride[2] = 1;
+  b->stride[1] = b->asz[2];
+  b->stride[0] = b->asz[1]*b->asz[2];
+  for(d=0; d<3; d++){
+    b->lo_nbr[d] = b->hi_nbr[d] = MPI_PROC_NULL;
+    if(d >= 3-ndims){
+      int sub[3], start[3] = {b->zoff, 1, 1};
+      MPI_Cart_shift(cart, d-(3-ndims), 1, &b->lo_nbr[d], &b->hi_nbr[d]);
+      sub[0] = b->lsz[0];
+      sub[1] = b->lsz[1];
+      sub[2] = b->lsz[2];
+      sub[d] = 1;       //the plane itself is picked by offsetting the buffer
+      start[d] = 0;
+      MPI_Type_create_subarray(3, b->asz, sub, start, MPI_ORDER_C, MPI_DOUBLE, &b->face[d]);
+      MPI_Type_commit(&b->face[d]);
+    }
+  }
+
+  ncells = b->asz[0]*b->asz[1]*b->asz[2];
+  cur = malloc(ncells * sizeof(double));
+  next = malloc(ncells * sizeof(double));
+  for(p=0; p<ncells; p++){
+    cur[p] = next[p] = initial_temp;
+  }
+  for(z=0; z<b->lsz[0]; z++){//the static faces never change so set them in both copies
+    for(y=0; y<b->lsz[1]; y++){
+      if(b->gst[2] == 0){
+        cur[IDX(b,z,y,0)] = next[IDX(b,z,y,0)] = L_bound_temp;
+      }
+      if(b->gst[2]+b->lsz[2] == b->gsz[2]){
+        x = b->lsz[2]-1;
+        cur[IDX(b,z,y,x)] = next[IDX(b,z,y,x)] = R_bound_temp;
+      }
+    }
+  }
+
+  for(t=0; t<max_time-1; t++){
+    exchange_faces(b, cur, cart);
+    mirror_faces(b, cur);
+    advance(b, next, cur);
+    tmp = cur;
+    cur = next;
+    next = tmp;
+  }
+
+  int astart[3] = {b->zoff, 1, 1};
+  if(outfile != NULL){
+    heat_header_t hdr;
+    heat_header_init(&hdr, ndims, n, 1, max_time-1,
+                     initial_temp, L_bound_temp, R_bound_temp, 0.5/ndims);
+    MPI_File fh = heat_open_output(cart, outfile, &hdr);
+    heat_write_grid(fh, cur, 3, b->asz, b->lsz, astart, b->gsz, b->gst);
+    MPI_File_close(&fh);
+  }
+  if(print == 1){
+    //every proc sends its box to root, which receives each one straight
+    //into its place in the full grid
+    MPI_Datatype owned;
+    MPI_Request req;
+    MPI_Type_create_subarray(3, b->asz, b->lsz, astart, MPI_ORDER_C, MPI_DOUBLE, &owned);
+    MPI_Type_commit(&owned);
+    MPI_Isend(cur, 1, owned, rootproc, 3, cart, &req);
+    if(cart_id == rootproc){
+      double *all = malloc(sizeof(double)*b->gsz[0]*b->gsz[1]*b->gsz[2]);
+      int i, rc[3], rl[3], rs[3];
+      for(i=0; i<npes; i++){
+        MPI_Datatype place;
+        MPI_Cart_coords(cart, i, ndims, rc);
+        find_box(ndims, b->gsz, pdims, rc, rl, rs);
+        MPI_Type_create_subarray(3, b->gsz, rl, rs, MPI_ORDER_C, MPI_DOUBLE, &place);
+        MPI_Type_commit(&place);
+        MPI_Recv(all, 1, place, i, 3, cart, MPI_STATUS_IGNORE);
+        MPI_Type_free(&place);
+      }
+      for(z=0; z<b->gsz[0]; z++){
+        heat_print_grid_header(stdout, ndims, z, max_time-1, b->gsz[2]);
+        for(y=0; y<b->gsz[1]; y++){
+          heat_print_table_row(stdout, y, &all[(z*b->gsz[1] + y)*b->gsz[2]], b->gsz[2]);
+        }
+      }
+      free(all);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+    MPI_Type_free(&owned);
+  }
+
+  for(d=3-ndims; d<3; d++){
+    MPI_Type_free(&b->face[d]);
+  }
+  free(cur);
+  free(next);
+  MPI_Comm_free(&cart);
+  MPI_Finalize();
+  return 0;
+}
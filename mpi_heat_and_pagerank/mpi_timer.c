@@ -0,0 +1,52 @@
+// Per phase wall clock timers, reduced across processors for reporting
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+#include <mpi_timer.h>
+
+void mpi_timer_init(mpi_timer_t *tm, int on, int nphases, const char **names){
+  int i;
+  tm->on = on;
+  tm->nphases = (nphases < MPI_TIMER_MAX) ? nphases : MPI_TIMER_MAX;
+  tm->names = names;
+  for(i=0; i<MPI_TIMER_MAX; i++){
+    tm->total[i] = 0.0;
+    tm->started[i] = 0.0;
+  }
+}
+
+void mpi_timer_start(mpi_timer_t *tm, int phase){
+  if(tm->on){
+    tm->started[phase] = MPI_Wtime();
+  }
+}
+
+void mpi_timer_stop(mpi_timer_t *tm, int phase){
+  if(tm->on){
+    tm->total[phase] += MPI_Wtime() - tm->started[phase];
+  }
+}
+
+// Collectively reduce every phase to its min, average and max over the
+// processors in comm and have the root print them as a table. Does
+// nothing if the timer is not on.
+void mpi_timer_report(mpi_timer_t *tm, MPI_Comm comm, FILE *out){
+  double lo[MPI_TIMER_MAX], hi[MPI_TIMER_MAX], sum[MPI_TIMER_MAX];
+  int proc_id, npes, i;
+  if(!tm->on){
+    return;
+  }
+  MPI_Comm_rank(comm, &proc_id);
+  MPI_Comm_size(comm, &npes);
+  MPI_Reduce(tm->total, lo, tm->nphases, MPI_DOUBLE, MPI_MIN, 0, comm);
+  MPI_Reduce(tm->total, hi, tm->nphases, MPI_DOUBLE, MPI_MAX, 0, comm);
+  MPI_Reduce(tm->total, sum, tm->nphases, MPI_DOUBLE, MPI_SUM, 0, comm);
+  if(proc_id == 0){
+    fprintf(out,"Timing over %d processors, seconds\n",npes);
+    fprintf(out,"%10s %12s %12s %12s\n","phase","min","avg","max");
+    for(i=0; i<tm->nphases; i++){
+      fprintf(out,"%10s %12.6f %12.6f %12.6f\n",tm->names[i],lo[i],sum[i]/npes,hi[i]);
+    }
+  }
+}
@@ -0,0 +1,34 @@
+// Header file for the phase timers and collective counts shared by the
+// MPI programs
+
+#ifndef MPI_TIMER_H
+#define MPI_TIMER_H
+
+#include <stdio.h>
+#include <mpi.h>
+
+#define MPI_TIMER_MAX 16              // most phases a program can time
+
+// Wall clock time spent in each phase of a program on this processor.
+// A timer that is not on ignores start and stop so the calls can stay
+// in the main loops at no cost.
+typedef struct {
+  int on;
+  int nphases;
+  const char **names;                 // one name per phase
+  double total[MPI_TIMER_MAX];        // seconds spent in each phase so far
+  double started[MPI_TIMER_MAX];      // MPI_Wtime when each phase was last started
+} mpi_timer_t;
+
+// mpi_timer.c
+void mpi_timer_init(mpi_timer_t *tm, int on, int nphases, const char **names);
+void mpi_timer_start(mpi_timer_t *tm, int phase);
+void mpi_timer_stop(mpi_timer_t *tm, int phase);
+void mpi_timer_report(mpi_timer_t *tm, MPI_Comm comm, FILE *out);
+
+// mpi_count.c
+// Linking it in wraps the collectives through the profiling interface
+void mpi_count_enable(int on);
+void mpi_count_report(MPI_Comm comm, FILE *out);
+
+#endif
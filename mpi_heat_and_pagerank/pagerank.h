@@ -0,0 +1,159 @@
+// Header file for the mpi_dense_pagerank programs
+
+#ifndef PAGERANK_H
+#define PAGERANK_H
+
+#include <stdio.h>
+#include <mpi.h>
+
+// Ways of iterating to the page ranks, picked with -method
+typedef enum {
+  PR_POWER,                     // plain power iteration
+  PR_GS,                        // Gauss-Seidel within each proc's rows, Jacobi between procs
+  PR_EXTRAP,                    // power iteration with periodic quadratic extrapolation
+  PR_ADAPTIVE                   // power iteration that stops recomputing converged pages
+} pr_method_t;
+
+#define PR_EXTRAP_EVERY 10            // power steps between extrapolations
+#define PR_ADAPTIVE_TOL 1e-5          // relative change below which a page is frozen
+
+// The threaded product can split the columns into blocks of this many
+// pages so the part of the rank vector being read stays in cache, 256 KB
+// of doubles for 32768. It only pays once the rank vector outgrows the
+// last level cache, so it is off unless built with -DPR_COL_BLOCK=n.
+// Matrices with no more columns than that are not blocked.
+#ifndef PR_COL_BLOCK
+#define PR_COL_BLOCK 0
+#endif
+#define PR_PREFETCH 16                // entries ahead to prefetch the ranks for
+
+// Binary graph files, see pr_bin.c for the layout. Files are written
+// in the native byte order of the machine that produced them.
+#define PR_MAGIC "PRCSR"
+#define PR_VERSION 1
+#define PR_HEADER_SIZE 64             // bytes reserved at the start of the file
+
+typedef struct {
+  char magic[8];                      // PR_MAGIC, null terminated
+  int version;                        // PR_VERSION
+  int nrows;                          // pages
+  long long nnz;                      // links, repeats removed
+  int nparts;                         // row parts in the partition table
+  int ordered;                        // 1 if the pages were renumbered and the order is stored
+} pr_header_t;
+
+// Saved ranks, a header of the same size followed by one double per page
+#define PR_RANKS_MAGIC "PRRANKS"
+
+typedef struct {
+  char magic[8];                      // PR_RANKS_MAGIC, null terminated
+  int version;                        // PR_VERSION
+  int nrows;                          // pages
+  double damping;                     // damping factor they were computed with
+  double change;                      // change in the last iteration
+} pr_ranks_header_t;
+
+// pr_csr.c
+// Compressed sparse rows for a block of rows of the link matrix. Entry
+// (r,c) is nonzero when the input has the line "r c". After
+// csr_normalize every entry in column c holds 1/outdeg[c], the share of
+// page c's rank passed along each of its links.
+typedef struct csr_plan csr_plan_t;
+
+typedef struct {
+  int nrows;                    // rows held here
+  int ncols;                    // columns held here, all the pages unless split in 2D
+  int first_row;                // global index of the first row held here
+  int nnz;                      // nonzeros held here
+  int *rowptr;                  // row r's entries are rowptr[r] .. rowptr[r+1]-1
+  int *colind;                  // column of each entry
+  double *val;                  // value of each entry
+  csr_plan_t *plan;             // thread split and column blocks, made by the first product
+} csr_t;
+
+csr_t *csr_from_edges(int nrows, int first_row, int ncols, int *edges, int nedges);
+void csr_free(csr_t *A);
+void csr_col_counts(csr_t *A, int *counts);
+void csr_normalize(csr_t *A, int *outdeg);
+void csr_spmv(csr_t *A, double *x, double *y);
+void csr_spmv_rows(csr_t *A, double *x, double *y, int *rows, int nrows_active);
+void csr_gs_sweep(csr_t *A, double *x, double scale, double shift);
+void csr_spmm(csr_t *A, double *X, double *Y, int k);
+void csr_apply_delta(csr_t *A, int *delta, int ndelta, int *applied);
+
+// pr_pattern.c
+// The columns of a csr_t without the values, which csr_normalize makes
+// 1/outdeg of the column anyway
+typedef struct {
+  int nrows;                    // as in the csr_t it was packed from
+  int ncols;
+  int first_row;
+  int nnz;
+  long long *rowptr;            // row r's gaps are bytes rowptr[r] .. rowptr[r+1]-1
+  unsigned char *gaps;          // varint gaps between the columns of each row
+  double *inv_outdeg;           // 1/outdeg of each column, 0 for pages with no links
+  double *scaled;               // the ranks times inv_outdeg, refreshed every step
+} pr_pattern_t;
+
+pr_pattern_t *pattern_from_csr(csr_t *A, int *outdeg);
+void pattern_free(pr_pattern_t *P);
+double pattern_bytes_per_link(pr_pattern_t *P);
+void pattern_power_step(pr_pattern_t *P, double *x, double *y, double damping, double teleport,
+                        double *sums);
+
+// pr_load.c
+int row_owner(int r, int n, int npes);
+int block_range(int n, int nblocks, int b, int *start);
+int *shuffle_edges(MPI_Comm comm, int *edges, int nedges, int n, int prow, int pcol,
+                   int *my_nedges);
+int *load_row_col_parallel(MPI_Comm comm, char *fname, int prow, int pcol,
+                           int *nrows, long long *nnz, int *my_nedges);
+int *read_delta(MPI_Comm comm, char *fname, int n, int *ndelta);
+
+// pr_bin.c
+int pr_is_binary(MPI_Comm comm, char *fname);
+void pr_write_binary(MPI_Comm comm, char *fname, csr_t *A, int n, int *outdeg, int nparts,
+                     int *order);
+csr_t *pr_read_binary(MPI_Comm comm, char *fname, int prow, int pcol,
+                      int *nrows, long long *nnz, int **outdeg, int **order);
+void pr_write_ranks(MPI_Comm comm, char *fname, double *ranks, int first_row, int nrows,
+                    int n, int *order, double damping, double change);
+void pr_read_ranks(MPI_Comm comm, char *fname, double *ranks, int n, int *order);
+void pr_write_vector(MPI_Comm comm, char *fname, double *ranks, int first_row, int nrows,
+                     int *order);
+
+// pr_batch.c
+void pagerank_batch(MPI_Comm comm, csr_t *A, int *outdeg, int n, int *counts, int *displs,
+                    char *fname, int *order, double tol, int max_iter);
+
+// pr_order.c
+int *pr_order_graph(MPI_Comm comm, csr_t *A, int n, char *method);
+int *pr_invert_order(int *order, int n);
+void pr_unpermute(double *ranks, int *order, int n);
+
+// pr_shared.c
+#define PR_SHARED_VECS 2              // the old and new ranks
+
+typedef struct pr_shared pr_shared_t;
+
+pr_shared_t *pr_shared_open(MPI_Comm comm, int n, int *counts, int *displs);
+double *pr_shared_vec(pr_shared_t *sh, int i);
+void pr_shared_exchange(pr_shared_t *sh, double *vec);
+void pr_shared_free(pr_shared_t *sh);
+
+// pr_io.c
+#define PR_TRACE_MAX 8                // most phases in a trace
+
+typedef struct pr_trace pr_trace_t;
+
+void pr_print_ranks(FILE *out, double change, double tol, double *ranks, int n);
+void pr_print_top(MPI_Comm comm, FILE *out, double change, double tol, double *ranks,
+                  int first_row, int nrows, int *order, int k);
+pr_trace_t *pr_trace_open(MPI_Comm comm, char *fname, int nphases, const char **names);
+void pr_trace_iter(pr_trace_t *tr, int iter, double change, double norm, double *secs);
+void pr_trace_close(pr_trace_t *tr);
+
+// pr_2d.c
+void pagerank_2d(MPI_Comm comm, char *fname, double damping_factor, double tol, int max_iter);
+
+#endif
@@ -0,0 +1,165 @@
+// PageRank on a checkerboard split of the link matrix. The npes = q*q
+// processors form a q x q grid and processor (i,j) holds the block of
+// rows i and columns j. Row and column blocks split the pages the same
+// way, and each block is split again into q parts; processor (i,j) owns
+// the ranks of part j of block i.
+//
+// An iteration
+//   expand: each proc sends its part to the proc across the diagonal,
+//           then the procs in a grid column gather their column block
+//           of ranks among themselves
+//   multiply: each proc multiplies its block by its column block
+//   fold:   the procs in a grid row sum their products and each keeps
+//           its own part with one reduce-scatter
+// so every collective runs over q procs and moves O(n/q) values, where
+// the row split sends the whole vector to everyone.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <mpi.h>
+#include <pagerank.h>
+
+void pagerank_2d(MPI_Comm comm, char *fname, double damping_factor, double tol, int max_iter){
+  int npes, proc_id, q, pi, pj, partner;
+  MPI_Comm rowc, colc;          // the procs in my grid row ranked by column, and my grid column ranked by row
+  int n, my_nedges, *edges;
+  long long nedges;
+  int rstart, rlen, cstart, clen, plen, k, r, iter;
+  int *part_counts, *part_displs, *col_counts, *col_displs, *own_counts, *own_displs;
+  int *outdeg_blk, *outdeg_own, *order = NULL;
+  double *x_blk, *y_blk, *x_own, *y_own, *ranks = NULL;
+  double sums[3], totals[3], diff, change = tol*10, teleport;
+  csr_t *A;
+
+  MPI_Comm_size(comm, &npes);
+  MPI_Comm_rank(comm, &proc_id);
+  q = (int) (sqrt((double) npes) + 0.5);
+  pi = proc_id / q;
+  pj = proc_id % q;
+  partner = pj*q + pi;          // across the diagonal
+  MPI_Comm_split(comm, pi, pj, &rowc);
+  MPI_Comm_split(comm, pj, pi, &colc);
+
+  // Out degrees are column sums, added up down each grid column, unless
+  // a binary graph brings them along
+  if(pr_is_binary(comm, fname)){
+    A = pr_read_binary(comm, fname, q, q, &n, &nedges, &outdeg_blk, &order);
+  }
+  else{
+    edges = load_row_col_parallel(comm, fname, q, q, &n, &nedges, &my_nedges);
+    rlen = block_range(n, q, pi, &rstart);
+    clen = block_range(n, q, pj, &cstart);
+    for(k=0; k<my_nedges; k++){//columns count from the start of the block
+      edges[2*k+1] -= cstart;
+    }
+    A = csr_from_edges(rlen, rstart, clen, edges, my_nedges);
+    free(edges);
+    outdeg_blk = calloc(clen > 0 ? clen : 1, sizeof(int));
+    csr_col_counts(A, outdeg_blk);
+    MPI_Allreduce(MPI_IN_PLACE, outdeg_blk, clen, MPI_INT, MPI_SUM, colc);
+  }
+  if(proc_id == 0){
+    printf("Loaded %s: %d rows, %lld nonzeros\n",fname,n,nedges);
+  }
+  rlen = A->nrows;
+  clen = A->ncols;
+  csr_normalize(A, outdeg_blk);
+
+  // Parts of my row block (for the fold) and my column block (for the
+  // expand). I own part pj of row block pi.
+  part_counts = malloc(q * sizeof(int));
+  part_displs = malloc(q * sizeof(int));
+  col_counts = malloc(q * sizeof(int));
+  col_displs = malloc(q * sizeof(int));
+  for(k=0; k<q; k++){
+    part_counts[k] = block_range(rlen, q, k, &part_displs[k]);
+    col_counts[k] = block_range(clen, q, k, &col_displs[k]);
+  }
+  plen = part_counts[pj];
+
+  // The out degrees for my own part come from the proc across the
+  // diagonal, which sits in the grid column holding my row block
+  outdeg_own = malloc((plen > 0 ? plen : 1) * sizeof(int));
+  MPI_Sendrecv(&outdeg_blk[col_displs[pi]], col_counts[pi], MPI_INT, partner, 1,
+               outdeg_own, plen, MPI_INT, partner, 1, comm, MPI_STATUS_IGNORE);
+
+  x_blk = malloc((clen > 0 ? clen : 1) * sizeof(double));
+  y_blk = malloc((rlen > 0 ? rlen : 1) * sizeof(double));
+  x_own = malloc((plen > 0 ? plen : 1) * sizeof(double));
+  y_own = malloc((plen > 0 ? plen : 1) * sizeof(double));
+  sums[2] = 0.0;
+  for(r=0; r<plen; r++){
+    x_own[r] = 1.0 / n;
+    sums[2] += (outdeg_own[r] == 0) ? x_own[r] : (1.0-damping_factor)*x_own[r];
+  }
+  MPI_Allreduce(&sums[2], &teleport, 1, MPI_DOUBLE, MPI_SUM, comm);
+  teleport /= n;
+
+  if(proc_id == 0){
+    printf("Beginning Computation\n\n%4s %8s %8s\n","ITER","DIFF","NORM");
+  }
+  for(iter=1; change > tol && iter<=max_iter; iter++){
+    // expand
+    MPI_Sendrecv(x_own, plen, MPI_DOUBLE, partner, 2,
+                 &x_blk[col_displs[pi]], col_counts[pi], MPI_DOUBLE, partner, 2,
+                 comm, MPI_STATUS_IGNORE);
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                   x_blk, col_counts, col_displs, MPI_DOUBLE, colc);
+    // multiply and fold
+    csr_spmv(A, x_blk, y_blk);
+    MPI_Reduce_scatter(y_blk, y_own, part_counts, MPI_DOUBLE, MPI_SUM, rowc);
+
+    sums[0] = sums[1] = sums[2] = 0.0;
+    for(r=0; r<plen; r++){
+      y_own[r] = damping_factor*y_own[r] + teleport;
+      diff = y_own[r] - x_own[r];
+      sums[0] += diff>0 ? diff : -diff;
+      sums[1] += y_own[r];
+      sums[2] += (outdeg_own[r] == 0) ? y_own[r] : (1.0-damping_factor)*y_own[r];
+      x_own[r] = y_own[r];
+    }
+    MPI_Allreduce(sums, totals, 3, MPI_DOUBLE, MPI_SUM, comm);
+    change = totals[0];
+    teleport = totals[2] / n;
+    if(proc_id == 0){
+      printf("%3d: %8.2e %8.2e\n",iter,change,totals[1]);
+    }
+  }
+
+  // Parts are numbered in page order, so a gather by rank lines them up
+  own_counts = malloc(npes * sizeof(int));
+  own_displs = malloc(npes * sizeof(int));
+  MPI_Gather(&plen, 1, MPI_INT, own_counts, 1, MPI_INT, 0, comm);
+  if(proc_id == 0){
+    ranks = malloc(n * sizeof(double));
+    for(k=0; k<npes; k++){
+      own_displs[k] = (k==0) ? 0 : own_displs[k-1]+own_counts[k-1];
+    }
+  }
+  MPI_Gatherv(x_own, plen, MPI_DOUBLE, ranks, own_counts, own_displs, MPI_DOUBLE, 0, comm);
+  if(proc_id == 0){
+    if(order != NULL){
+      pr_unpermute(ranks, order, n);
+    }
+    pr_print_ranks(stdout, change, tol, ranks, n);
+    free(ranks);
+  }
+
+  csr_free(A);
+  free(part_counts);
+  free(part_displs);
+  free(col_counts);
+  free(col_displs);
+  free(own_counts);
+  free(own_displs);
+  free(outdeg_blk);
+  free(outdeg_own);
+  free(order);
+  free(x_blk);
+  free(y_blk);
+  free(x_own);
+  free(y_own);
+  MPI_Comm_free(&rowc);
+  MPI_Comm_free(&colc);
+}
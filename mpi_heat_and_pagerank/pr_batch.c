@@ -0,0 +1,285 @@
+// A batch of PageRank vectors over one link matrix, for sweeps over
+// the damping factor and for personalized ranks whose teleport mass
+// goes only to a chosen set of pages. The batch file has one vector
+// per line,
+//   damping [page page ...]
+// teleporting to every page when no pages are listed, skipping blank
+// lines and lines starting with #.
+//
+// Like the ensemble of rods the vectors are interleaved page by page,
+// so one pass over the matrix multiplies all of them and each exchange
+// is a single message. A vector leaves the batch as soon as it
+// converges and the rest are packed together, so the late iterations
+// only pay for the vectors still running.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include <pagerank.h>
+
+typedef struct {
+  int m;                        // vectors in the batch
+  double *damping;              // of each vector
+  int *first;                   // vector j teleports to pages[first[j] .. first[j+1]-1], every page if none
+  int *pages;
+} batch_t;
+
+// Read the batch on the root. Returns the number of vectors, 0 if the
+// file could not be read or names a page outside the n pages.
+static int read_batch(char *fname, int n, batch_t *b){
+  FILE *f = fopen(fname,"r");
+  char *line = NULL, *p, *end;
+  size_t len = 0;
+  int size = 16, psize = 64, npages = 0, lineno = 0;
+  double d;
+  long page;
+  if(f == NULL){
+    perror(fname);
+    return 0;
+  }
+  b->m = 0;
+  b->damping = malloc(size * sizeof(double));
+  b->first = malloc((size+1) * sizeof(int));
+  b->pages = malloc(psize * sizeof(int));
+  b->first[0] = 0;
+  while(getline(&line, &len, f) != -1){
+    lineno++;
+    d = strtod(line, &end);
+    if(line[0] == '#' || end == line){
+      continue;
+    }
+    if(b->m == size){
+      size *= 2;
+      b->damping = realloc(b->damping, size * sizeof(double));
+      b->first = realloc(b->first, (size+1) * sizeof(int));
+    }
+    for(p=end, page=strtol(p, &end, 10); end != p; p=end, page=strtol(p, &end, 10)){
+      if(page < 0 || page >= n){
+        fprintf(stderr,"ERROR: page %ld on line %d of %s is not in the graph of %d pages\n",page,lineno,fname,n);
+        b->m = 0;
+        break;
+      }
+      if(npages == psize){
+        psize *= 2;
+        b->pages = realloc(b->pages, psize * sizeof(int));
+      }
+      b->pages[npages++] = page;
+    }
+    if(end != p){//stopped on a bad page
+      break;
+    }
+    b->damping[b->m++] = d;
+    b->first[b->m] = npages;
+  }
+  free(line);
+  fclose(f);
+  return b->m;
+}
+
+// Root reads the batch and everyone gets a copy
+static void share_batch(MPI_Comm comm, char *fname, int n, batch_t *b){
+  int proc_id, npages = 0;
+  MPI_Comm_rank(comm, &proc_id);
+  if(proc_id == 0){
+    read_batch(fname, n, b);
+    npages = (b->m > 0) ? b->first[b->m] : 0;
+  }
+  MPI_Bcast(&b->m, 1, MPI_INT, 0, comm);
+  MPI_Bcast(&npages, 1, MPI_INT, 0, comm);
+  if(b->m == 0){
+    if(proc_id == 0){
+      fprintf(stderr,"ERROR: no vectors in %s\n",fname);
+    }
+    MPI_Abort(comm, 1);
+  }
+  if(proc_id != 0){
+    b->damping = malloc(b->m * sizeof(double));
+    b->first = malloc((b->m+1) * sizeof(int));
+    b->pages = malloc((npages > 0 ? npages : 1) * sizeof(int));
+  }
+  MPI_Bcast(b->damping, b->m, MPI_DOUBLE, 0, comm);
+  MPI_Bcast(b->first, b->m+1, MPI_INT, 0, comm);
+  MPI_Bcast(b->pages, npages, MPI_INT, 0, comm);
+}
+
+// Iterate every vector of the batch in fname to within tol or max_iter
+// iterations and print each on the root. A holds this proc's rows of
+// the normalized link matrix and outdeg every page's out degree; counts
+// and displs give every proc's rows. If the pages were renumbered order
+// gives their old numbers, which the batch file and the output use.
+// Collective over comm.
+void pagerank_batch(MPI_Comm comm, csr_t *A, int *outdeg, int n, int *counts, int *displs,
+                    char *fname, int *order, double tol, int max_iter){
+  batch_t b;
+  int proc_id, npes, nloc = A->nrows, k, keep, iter, i, j, r, c;
+  int *slot, *from, *iters, *rcounts, *rdispls;
+  double *X, *Y, *W, *d, *tele, *sums, *totals, *changes, *out, *ranks = NULL;
+  double y, diff;
+  MPI_Request reqs[2];
+
+  MPI_Comm_rank(comm, &proc_id);
+  MPI_Comm_size(comm, &npes);
+  share_batch(comm, fname, n, &b);
+  k = b.m;
+  if(order != NULL){
+    int *renumber = pr_invert_order(order, n);
+    for(i=0; i<b.first[k]; i++){
+      b.pages[i] = renumber[b.pages[i]];
+    }
+    free(renumber);
+  }
+
+  // Slot j of the interleaved vectors holds vector slot[j] of the batch
+  slot = malloc(k * sizeof(int));
+  from = malloc(k * sizeof(int));
+  d = malloc(k * sizeof(double));
+  tele = malloc(k * sizeof(double));
+  sums = malloc(2*k * sizeof(double));
+  totals = malloc(2*k * sizeof(double));
+  X = malloc((size_t) n*k * sizeof(double));
+  Y = malloc((size_t) (nloc > 0 ? nloc : 1)*k * sizeof(double));
+  W = calloc((size_t) (nloc > 0 ? nloc : 1)*k, sizeof(double));
+  out = malloc((nloc > 0 ? nloc : 1) * sizeof(double));
+  rcounts = malloc(npes * sizeof(int));
+  rdispls = malloc(npes * sizeof(int));
+  iters = malloc(k * sizeof(int));
+  changes = malloc(k * sizeof(double));
+  if(proc_id == 0){
+    ranks = malloc((size_t) n*k * sizeof(double));
+  }
+
+  // W is each vector's share of the teleport mass for this proc's pages
+  for(j=0; j<k; j++){
+    slot[j] = j;
+    d[j] = b.damping[j];
+    for(c=0; c<n; c++){
+      X[c*k+j] = 1.0 / n;
+    }
+    if(b.first[j] == b.first[j+1]){
+      for(r=0; r<nloc; r++){
+        W[r*k+j] = 1.0 / n;
+      }
+    }
+    for(i=b.first[j]; i<b.first[j+1]; i++){
+      r = b.pages[i] - A->first_row;
+      if(r >= 0 && r < nloc){
+        W[r*k+j] += 1.0 / (b.first[j+1]-b.first[j]);
+      }
+    }
+  }
+  // As in the single vector case the teleport mass is the (1-damping)
+  // share of every rank plus the rank of pages with no links
+  for(j=0; j<k; j++){
+    sums[j] = 0.0;
+    for(r=0; r<nloc; r++){
+      c = A->first_row + r;
+      sums[j] += (outdeg[c] == 0) ? X[c*k+j] : (1.0-d[j])*X[c*k+j];
+    }
+  }
+  MPI_Allreduce(sums, tele, k, MPI_DOUBLE, MPI_SUM, comm);
+
+  if(proc_id == 0){
+    printf("Beginning Computation of %d vectors\n\n%4s %7s %8s\n",k,"ITER","ACTIVE","DIFF");
+  }
+  for(iter=1; k > 0; iter++){
+    csr_spmm(A, X, Y, k);
+    for(j=0; j<2*k; j++){
+      sums[j] = 0.0;
+    }
+    for(r=0; r<nloc; r++){
+      c = A->first_row + r;
+      for(j=0; j<k; j++){
+        y = d[j]*Y[r*k+j] + tele[j]*W[r*k+j];
+        diff = y - X[c*k+j];
+        sums[2*j] += diff>0 ? diff : -diff;
+        sums[2*j+1] += (outdeg[c] == 0) ? y : (1.0-d[j])*y;
+        Y[r*k+j] = y;
+      }
+    }
+    for(i=0; i<npes; i++){
+      rcounts[i] = counts[i]*k;
+      rdispls[i] = displs[i]*k;
+    }
+    MPI_Iallgatherv(Y, nloc*k, MPI_DOUBLE, X, rcounts, rdispls, MPI_DOUBLE, comm, &reqs[0]);
+    MPI_Iallreduce(sums, totals, 2*k, MPI_DOUBLE, MPI_SUM, comm, &reqs[1]);
+    MPI_Waitall(2, reqs, MPI_STATUSES_IGNORE);
+
+    // Retire the vectors that are done, gathering each to the root
+    keep = 0;
+    diff = 0.0;
+    for(j=0; j<k; j++){
+      diff = (totals[2*j] > diff) ? totals[2*j] : diff;
+      if(totals[2*j] <= tol || iter == max_iter){
+        for(r=0; r<nloc; r++){
+          out[r] = X[(A->first_row+r)*k+j];
+        }
+        MPI_Gatherv(out, nloc, MPI_DOUBLE, (proc_id == 0) ? &ranks[(size_t) slot[j]*n] : NULL,
+                    counts, displs, MPI_DOUBLE, 0, comm);
+        iters[slot[j]] = iter;
+        changes[slot[j]] = totals[2*j];
+      }
+      else{
+        from[keep] = j;
+        slot[keep] = slot[j];
+        d[keep] = d[j];
+        tele[keep] = totals[2*j+1];
+        keep++;
+      }
+    }
+    if(proc_id == 0){
+      printf("%3d: %7d %8.2e\n",iter,k,diff);
+    }
+    // Pack the survivors. Each value moves to the same or an earlier
+    // place, so going front to back never overwrites one still needed.
+    if(keep < k){
+      for(c=0; c<n; c++){
+        for(j=0; j<keep; j++){
+          X[c*keep+j] = X[c*k+from[j]];
+        }
+      }
+      for(r=0; r<nloc; r++){
+        for(j=0; j<keep; j++){
+          W[r*keep+j] = W[r*k+from[j]];
+        }
+      }
+    }
+    k = keep;
+  }
+
+  if(proc_id == 0){
+    for(j=0; j<b.m; j++){
+      printf("\nVECTOR %d: damping %g, ",j,b.damping[j]);
+      if(b.first[j] == b.first[j+1]){
+        printf("teleport to every page");
+      }
+      else{
+        printf("teleport to %d pages",b.first[j+1]-b.first[j]);
+      }
+      printf(", %d iterations\n",iters[j]);
+      if(order != NULL){
+        pr_unpermute(&ranks[(size_t) j*n], order, n);
+      }
+      pr_print_ranks(stdout, changes[j], tol, &ranks[(size_t) j*n], n);
+    }
+    free(ranks);
+  }
+
+  free(slot);
+  free(from);
+  free(d);
+  free(tele);
+  free(sums);
+  free(totals);
+  free(X);
+  free(Y);
+  free(W);
+  free(out);
+  free(rcounts);
+  free(rdispls);
+  free(iters);
+  free(changes);
+  free(b.damping);
+  free(b.first);
+  free(b.pages);
+}
@@ -0,0 +1,427 @@
+// Binary graph files for the pagerank programs, written once by
+// pr_convert so later runs skip parsing the text edge list. After the
+// header come
+//   the partition table, nparts+1 ints giving the first row of each part
+//   the row pointers, nrows+1 long longs counting from the first entry
+//   the column of every entry, nnz ints, sorted within each row
+//   the out degree of every page, nrows ints
+//   if the pages were renumbered, the old number of every page, nrows ints
+// so each processor reads its own rows with a few contiguous reads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <mpi.h>
+#include <pagerank.h>
+
+#define READ_CHUNK (1<<20)            // columns read at a time when keeping a block of them
+
+// Where each section of the file starts
+static MPI_Offset parts_offset(pr_header_t *hdr){
+  return PR_HEADER_SIZE;
+}
+
+static MPI_Offset rowptr_offset(pr_header_t *hdr){
+  return parts_offset(hdr) + (MPI_Offset) (hdr->nparts+1)*sizeof(int);
+}
+
+static MPI_Offset colind_offset(pr_header_t *hdr){
+  return rowptr_offset(hdr) + (MPI_Offset) (hdr->nrows+1)*sizeof(long long);
+}
+
+static MPI_Offset outdeg_offset(pr_header_t *hdr){
+  return colind_offset(hdr) + (MPI_Offset) hdr->nnz*sizeof(int);
+}
+
+static MPI_Offset order_offset(pr_header_t *hdr){
+  return outdeg_offset(hdr) + (MPI_Offset) hdr->nrows*sizeof(int);
+}
+
+// Collectively check whether fname is a binary graph file rather than
+// a text edge list
+int pr_is_binary(MPI_Comm comm, char *fname){
+  int proc_id, is_bin = 0;
+  MPI_Comm_rank(comm, &proc_id);
+  if(proc_id == 0){
+    char magic[8];
+    FILE *f = fopen(fname,"rb");
+    if(f != NULL){
+      is_bin = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+               strncmp(magic, PR_MAGIC, sizeof(magic)) == 0;
+      fclose(f);
+    }
+  }
+  MPI_Bcast(&is_bin, 1, MPI_INT, 0, comm);
+  return is_bin;
+}
+
+// Collectively write a graph whose rows are split across the
+// processors in comm, each holding rows A->first_row on with every
+// column. outdeg has every page's out degree. The file gets a table of
+// nparts parts of nearly equal nonzeros, none if nparts is 0. order,
+// if not NULL, gives the old number of every page after a renumbering
+// and is stored so the ranks can be printed in the old numbering.
+void pr_write_binary(MPI_Comm comm, char *fname, csr_t *A, int n, int *outdeg, int nparts,
+                     int *order){
+  MPI_File fh;
+  pr_header_t hdr;
+  char buf[PR_HEADER_SIZE];
+  long long my_nnz = A->nnz, before = 0, total;
+  long long *rowptr;
+  int *parts;
+  int proc_id, npes, err, r, b, last;
+
+  MPI_Comm_rank(comm, &proc_id);
+  MPI_Comm_size(comm, &npes);
+  MPI_Exscan(&my_nnz, &before, 1, MPI_LONG_LONG, MPI_SUM, comm);
+  if(proc_id == 0){
+    before = 0;                 // Exscan leaves the root's undefined
+  }
+  MPI_Allreduce(&my_nnz, &total, 1, MPI_LONG_LONG, MPI_SUM, comm);
+
+  // Part b starts at the first row with at least b/nparts of the
+  // nonzeros before it. Each proc finds the ones in its rows.
+  parts = malloc((nparts+1) * sizeof(int));
+  for(b=0; b<=nparts; b++){
+    parts[b] = n;
+    for(r=0; b > 0 && r<A->nrows; r++){
+      if((before + A->rowptr[r])*nparts >= b*total){
+        parts[b] = A->first_row + r;
+        break;
+      }
+    }
+  }
+  MPI_Allreduce(MPI_IN_PLACE, parts, nparts+1, MPI_INT, MPI_MIN, comm);
+  if(nparts > 0){
+    parts[0] = 0;
+    parts[nparts] = n;
+  }
+
+  memset(buf, 0, PR_HEADER_SIZE);
+  memset(&hdr, 0, sizeof(pr_header_t));
+  strncpy(hdr.magic, PR_MAGIC, sizeof(hdr.magic));
+  hdr.version = PR_VERSION;
+  hdr.nrows = n;
+  hdr.nnz = total;
+  hdr.nparts = nparts;
+  hdr.ordered = (order != NULL);
+  memcpy(buf, &hdr, sizeof(pr_header_t));
+
+  err = MPI_File_open(comm, fname, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+  if(err != MPI_SUCCESS){
+    if(proc_id == 0){
+      fprintf(stderr,"ERROR: could not open %s for writing\n",fname);
+    }
+    MPI_Abort(comm, 1);
+  }
+  MPI_File_set_size(fh, 0);
+  if(proc_id == 0){
+    MPI_File_write_at(fh, 0, buf, PR_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_write_at(fh, parts_offset(&hdr), parts, nparts+1, MPI_INT, MPI_STATUS_IGNORE);
+    if(order != NULL){
+      MPI_File_write_at(fh, order_offset(&hdr), order, n, MPI_INT, MPI_STATUS_IGNORE);
+    }
+  }
+
+  // The proc holding the last row also writes the end of the row pointers
+  last = (A->first_row + A->nrows == n) ? 1 : 0;
+  rowptr = malloc((A->nrows+1) * sizeof(long long));
+  for(r=0; r<=A->nrows; r++){
+    rowptr[r] = before + A->rowptr[r];
+  }
+  MPI_File_write_at_all(fh, rowptr_offset(&hdr) + (MPI_Offset) A->first_row*sizeof(long long),
+                        rowptr, A->nrows+last, MPI_LONG_LONG, MPI_STATUS_IGNORE);
+  MPI_File_write_at_all(fh, colind_offset(&hdr) + (MPI_Offset) before*sizeof(int),
+                        A->colind, A->nnz, MPI_INT, MPI_STATUS_IGNORE);
+  MPI_File_write_at_all(fh, outdeg_offset(&hdr) + (MPI_Offset) A->first_row*sizeof(int),
+                        &outdeg[A->first_row], A->nrows, MPI_INT, MPI_STATUS_IGNORE);
+  MPI_File_close(&fh);
+  free(rowptr);
+  free(parts);
+}
+
+// Collectively read a binary graph file. The matrix is split into prow
+// blocks of rows by pcol blocks of columns as in load_row_col_parallel
+// and processor i*pcol+j gets block (i,j) with its columns counted from
+// the start of the column block. When the rows are split over every
+// processor and the file has a table of that many parts its split is
+// used instead. Sets nrows and nnz for the whole matrix and outdeg to a
+// new array with the out degrees of the columns held here. order is
+// set to a new array with the stored renumbering, or NULL if the pages
+// were not renumbered. Entries start out as 1.0.
+csr_t *pr_read_binary(MPI_Comm comm, char *fname, int prow, int pcol,
+                      int *nrows, long long *nnz, int **outdeg, int **order){
+  MPI_File fh;
+  pr_header_t hdr;
+  char buf[PR_HEADER_SIZE];
+  csr_t *A;
+  long long *rowptr, my_nnz, lo, e, nkeep = 0, size;
+  int proc_id, npes, err, ok = 1, r, k, nchunks, len;
+  int rstart, rlen, cstart, clen, bi, bj, *cols;
+
+  MPI_Comm_rank(comm, &proc_id);
+  MPI_Comm_size(comm, &npes);
+  err = MPI_File_open(comm, fname, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+  if(err != MPI_SUCCESS){
+    if(proc_id == 0){
+      fprintf(stderr,"ERROR: could not open %s for reading\n",fname);
+    }
+    MPI_Abort(comm, 1);
+  }
+  MPI_File_read_at_all(fh, 0, buf, PR_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+  memcpy(&hdr, buf, sizeof(pr_header_t));
+  if(proc_id == 0 && hdr.version != PR_VERSION){
+    fprintf(stderr,"ERROR: %s has version %d, expected %d\n",fname,hdr.version,PR_VERSION);
+    ok = 0;
+  }
+  MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+  if(!ok){
+    MPI_Abort(comm, 1);
+  }
+  *nrows = hdr.nrows;
+  *nnz = hdr.nnz;
+
+  bi = proc_id / pcol;
+  bj = proc_id % pcol;
+  rlen = block_range(hdr.nrows, prow, bi, &rstart);
+  clen = block_range(hdr.nrows, pcol, bj, &cstart);
+  if(pcol == 1 && hdr.nparts == prow){
+    int ends[2];
+    MPI_File_read_at(fh, parts_offset(&hdr) + (MPI_Offset) bi*sizeof(int), ends, 2, MPI_INT,
+                     MPI_STATUS_IGNORE);
+    rstart = ends[0];
+    rlen = ends[1] - ends[0];
+  }
+
+  rowptr = malloc((rlen+1) * sizeof(long long));
+  MPI_File_read_at_all(fh, rowptr_offset(&hdr) + (MPI_Offset) rstart*sizeof(long long),
+                       rowptr, rlen+1, MPI_LONG_LONG, MPI_STATUS_IGNORE);
+  A = malloc(sizeof(csr_t));
+  A->nrows = rlen;
+  A->ncols = clen;
+  A->first_row = rstart;
+  A->plan = NULL;
+  A->rowptr = malloc((rlen+1) * sizeof(int));
+
+  // Read the columns of these rows a chunk at a time. With the rows
+  // split alone every one is kept and read straight into place, else
+  // only the ones in this proc's block are kept, counted from its
+  // start. The rows are sorted so they stay sorted. The reads are
+  // collective, so everyone makes as many as the proc with the most.
+  my_nnz = rowptr[rlen] - rowptr[0];
+  if(pcol == 1 && my_nnz > INT_MAX){//the entries held here are counted in an int
+    fprintf(stderr,"ERROR: %lld links for one processor, at most %d, use more processors\n",
+            my_nnz, INT_MAX);
+    MPI_Abort(comm, 1);
+  }
+  nchunks = (my_nnz + READ_CHUNK-1) / READ_CHUNK;
+  MPI_Allreduce(MPI_IN_PLACE, &nchunks, 1, MPI_INT, MPI_MAX, comm);
+  size = (pcol == 1) ? my_nnz : ((my_nnz < READ_CHUNK) ? my_nnz : READ_CHUNK);
+  A->colind = malloc((size > 0 ? size : 1) * sizeof(int));
+  cols = (pcol == 1) ? NULL : malloc(READ_CHUNK * sizeof(int));
+  A->rowptr[0] = 0;
+  for(k=0, r=0; k<nchunks; k++){
+    lo = (long long) k*READ_CHUNK;
+    lo = (lo < my_nnz) ? lo : my_nnz;
+    len = (my_nnz-lo < READ_CHUNK) ? (int) (my_nnz-lo) : READ_CHUNK;
+    MPI_File_read_at_all(fh, colind_offset(&hdr) + (MPI_Offset) (rowptr[0]+lo)*sizeof(int),
+                         (pcol == 1) ? &A->colind[lo] : cols, len, MPI_INT, MPI_STATUS_IGNORE);
+    for(e=lo; pcol > 1 && e<lo+len; e++){
+      for(; rowptr[r+1]-rowptr[0] <= e; r++){
+        A->rowptr[r+1] = nkeep;
+      }
+      if(cols[e-lo] >= cstart && cols[e-lo] < cstart+clen){
+        if(nkeep == INT_MAX){
+          fprintf(stderr,"ERROR: over %d links for one processor, use more processors\n",
+                  INT_MAX);
+          MPI_Abort(comm, 1);
+        }
+        if(nkeep == size){
+          size = (2*size < INT_MAX) ? 2*size : INT_MAX;
+          A->colind = realloc(A->colind, size * sizeof(int));
+        }
+        A->colind[nkeep++] = cols[e-lo] - cstart;
+      }
+    }
+  }
+  if(pcol == 1){
+    for(r=0; r<rlen; r++){
+      A->rowptr[r+1] = rowptr[r+1] - rowptr[0];
+    }
+    nkeep = my_nnz;
+  }
+  for(; r<rlen; r++){
+    A->rowptr[r+1] = nkeep;
+  }
+  free(cols);
+  A->nnz = nkeep;
+  A->colind = realloc(A->colind, (nkeep > 0 ? nkeep : 1) * sizeof(int));
+
+  *outdeg = malloc((clen > 0 ? clen : 1) * sizeof(int));
+  MPI_File_read_at_all(fh, outdeg_offset(&hdr) + (MPI_Offset) cstart*sizeof(int),
+                       *outdeg, clen, MPI_INT, MPI_STATUS_IGNORE);
+  *order = NULL;
+  if(hdr.ordered){
+    *order = malloc((hdr.nrows > 0 ? hdr.nrows : 1) * sizeof(int));
+    MPI_File_read_at_all(fh, order_offset(&hdr), *order, hdr.nrows, MPI_INT, MPI_STATUS_IGNORE);
+  }
+  MPI_File_close(&fh);
+
+  A->val = malloc((nkeep > 0 ? nkeep : 1) * sizeof(double));
+  for(e=0; e<nkeep; e++){
+    A->val[e] = 1.0;
+  }
+  free(rowptr);
+  return A;
+}
+
+// A rank and the place it goes in the file
+typedef struct {
+  int page;
+  double rank;
+} placed_t;
+
+static int compare_placed(const void *a, const void *b){
+  int x = ((const placed_t *) a)->page, y = ((const placed_t *) b)->page;
+  return (x > y) - (x < y);
+}
+
+// Collectively write rows first_row .. first_row+nrows-1 of ranks as
+// doubles in page order from byte disp of fh on. If the pages were
+// renumbered order gives their old numbers and the file is in those,
+// each proc's pages scattered through it by a file view.
+static void write_pages(MPI_File fh, MPI_Offset disp, double *ranks, int first_row, int nrows,
+                        int *order){
+  MPI_Datatype filetype;
+  int r;
+  if(order == NULL){
+    MPI_File_write_at_all(fh, disp + (MPI_Offset) first_row*sizeof(double), &ranks[first_row],
+                          nrows, MPI_DOUBLE, MPI_STATUS_IGNORE);
+  }
+  else{
+    // A view needs the places in increasing order, so sort this proc's
+    // pages by old number and write their ranks in that order
+    placed_t *pv = malloc((nrows > 0 ? nrows : 1) * sizeof(placed_t));
+    int *places = malloc((nrows > 0 ? nrows : 1) * sizeof(int));
+    double *buf = malloc((nrows > 0 ? nrows : 1) * sizeof(double));
+    for(r=0; r<nrows; r++){
+      pv[r].page = order[first_row + r];
+      pv[r].rank = ranks[first_row + r];
+    }
+    qsort(pv, nrows, sizeof(placed_t), compare_placed);
+    for(r=0; r<nrows; r++){
+      places[r] = pv[r].page;
+      buf[r] = pv[r].rank;
+    }
+    MPI_Type_create_indexed_block(nrows, 1, places, MPI_DOUBLE, &filetype);
+    MPI_Type_commit(&filetype);
+    MPI_File_set_view(fh, disp, MPI_DOUBLE, filetype, "native", MPI_INFO_NULL);
+    MPI_File_write_all(fh, buf, nrows, MPI_DOUBLE, MPI_STATUS_IGNORE);
+    MPI_Type_free(&filetype);
+    free(pv);
+    free(places);
+    free(buf);
+  }
+}
+
+// Collectively write the ranks of all n pages to fname, each proc
+// writing its own rows first_row .. first_row+nrows-1 of ranks. The
+// header records the damping factor and the last change of the
+// iteration. The ranks are saved in the old page numbers if order is
+// not NULL, so they go with any numbering of the same graph.
+void pr_write_ranks(MPI_Comm comm, char *fname, double *ranks, int first_row, int nrows,
+                    int n, int *order, double damping, double change){
+  MPI_File fh;
+  pr_ranks_header_t hdr;
+  char buf[PR_HEADER_SIZE];
+  int proc_id, err;
+  MPI_Comm_rank(comm, &proc_id);
+  err = MPI_File_open(comm, fname, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+  if(err != MPI_SUCCESS){
+    if(proc_id == 0){
+      fprintf(stderr,"ERROR: could not open %s for writing\n",fname);
+    }
+    MPI_Abort(comm, 1);
+  }
+  MPI_File_set_size(fh, 0);
+  if(proc_id == 0){
+    memset(buf, 0, PR_HEADER_SIZE);
+    memset(&hdr, 0, sizeof(pr_ranks_header_t));
+    strncpy(hdr.magic, PR_RANKS_MAGIC, sizeof(hdr.magic));
+    hdr.version = PR_VERSION;
+    hdr.nrows = n;
+    hdr.damping = damping;
+    hdr.change = change;
+    memcpy(buf, &hdr, sizeof(pr_ranks_header_t));
+    MPI_File_write_at(fh, 0, buf, PR_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+  }
+  write_pages(fh, PR_HEADER_SIZE, ranks, first_row, nrows, order);
+  MPI_File_close(&fh);
+}
+
+// Collectively read the ranks of all n pages from a file written by
+// pr_write_ranks into ranks on every proc, renumbered by order if the
+// graph's pages were. Aborts if the file does not hold n ranks.
+void pr_read_ranks(MPI_Comm comm, char *fname, double *ranks, int n, int *order){
+  MPI_File fh;
+  pr_ranks_header_t hdr;
+  char buf[PR_HEADER_SIZE];
+  int proc_id, err, ok = 1;
+  MPI_Comm_rank(comm, &proc_id);
+  err = MPI_File_open(comm, fname, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+  if(err != MPI_SUCCESS){
+    if(proc_id == 0){
+      fprintf(stderr,"ERROR: could not open %s for reading\n",fname);
+    }
+    MPI_Abort(comm, 1);
+  }
+  MPI_File_read_at_all(fh, 0, buf, PR_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE);
+  memcpy(&hdr, buf, sizeof(pr_ranks_header_t));
+  if(proc_id == 0){//everyone read the same header, only the root complains
+    if(strncmp(hdr.magic, PR_RANKS_MAGIC, sizeof(hdr.magic)) != 0){
+      fprintf(stderr,"ERROR: %s is not a page rank file\n",fname);
+      ok = 0;
+    }
+    else if(hdr.nrows != n){
+      fprintf(stderr,"ERROR: %s has ranks for %d pages, the graph has %d\n",fname,hdr.nrows,n);
+      ok = 0;
+    }
+  }
+  MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+  if(!ok){
+    MPI_Abort(comm, 1);
+  }
+  MPI_File_read_at_all(fh, PR_HEADER_SIZE, ranks, n, MPI_DOUBLE, MPI_STATUS_IGNORE);
+  MPI_File_close(&fh);
+  if(order != NULL){//page i of the graph is page order[i] of the file
+    double *tmp = malloc(n * sizeof(double));
+    int i;
+    memcpy(tmp, ranks, n * sizeof(double));
+    for(i=0; i<n; i++){
+      ranks[i] = tmp[order[i]];
+    }
+    free(tmp);
+  }
+}
+
+// Collectively write the ranks of all n pages to fname as a bare
+// vector of n doubles in page order, no header, each proc writing its
+// own rows first_row .. first_row+nrows-1 of ranks. If the pages were
+// renumbered order gives their old numbers and the file is in those.
+void pr_write_vector(MPI_Comm comm, char *fname, double *ranks, int first_row, int nrows,
+                     int *order){
+  MPI_File fh;
+  int proc_id, err;
+  MPI_Comm_rank(comm, &proc_id);
+  err = MPI_File_open(comm, fname, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+  if(err != MPI_SUCCESS){
+    if(proc_id == 0){
+      fprintf(stderr,"ERROR: could not open %s for writing\n",fname);
+    }
+    MPI_Abort(comm, 1);
+  }
+  MPI_File_set_size(fh, 0);
+  write_pages(fh, 0, ranks, first_row, nrows, order);
+  MPI_File_close(&fh);
+}
@@ -0,0 +1,111 @@
+// Convert a row/col text edge list into the binary graph file read by
+// mpi_dense_pagerank, so the text is parsed once rather than on every
+// run. Repeated edges are dropped and the out degrees are stored. The
+// pages can be renumbered on the way for locality, see pr_order.c;
+// mpi_dense_pagerank still takes and prints pages in the old numbers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include <pagerank.h>
+
+// Links whose two pages fall in different processors' blocks of rows,
+// each of those is a rank that has to be sent between processors
+static long long cut_links(MPI_Comm comm, csr_t *A, int n){
+  int npes, proc_id, k;
+  long long cut = 0, total;
+  MPI_Comm_size(comm, &npes);
+  MPI_Comm_rank(comm, &proc_id);
+  for(k=0; k<A->nnz; k++){
+    cut += (row_owner(A->colind[k], n, npes) != proc_id);
+  }
+  MPI_Allreduce(&cut, &total, 1, MPI_LONG_LONG, MPI_SUM, comm);
+  return total;
+}
+
+int main(int argc, char **argv){
+  int npes, proc_id;
+  MPI_Init (&argc, &argv);                      /* starts MPI */
+  MPI_Comm_rank (MPI_COMM_WORLD, &proc_id);     /* get current process id */
+  MPI_Comm_size (MPI_COMM_WORLD, &npes);        /* get number of processes */
+
+  if(argc < 3){
+    if(proc_id == 0){
+      printf("usage: %s row_col.txt graph.bin [-parts k] [-reorder rcm|degree|lp]\n  -parts: store a split of the rows into k parts of nearly equal links, used when running on k processors\n  -reorder: renumber the pages for locality by reverse Cuthill-McKee, by number of links, or by label propagation clusters\n",argv[0]);
+    }
+    MPI_Finalize();
+    return 0;
+  }
+
+  int nparts = 0;
+  char *reorder = NULL;         // how to renumber the pages
+  int *order = NULL;            // old number of each page after renumbering
+  int n, my_nedges, first_row, nrows, p;
+  long long nedges;
+  int *my_edges, *outdeg;
+  csr_t *A;
+
+  for(p=3; p<argc; p++){//optional flags after the positional args
+    if(strcmp(argv[p],"-parts") == 0 && p+1 < argc){
+      nparts = atoi(argv[++p]);
+    }
+    else if(strcmp(argv[p],"-reorder") == 0 && p+1 < argc){
+      reorder = argv[++p];
+    }
+    else{
+      if(proc_id == 0){ printf("unknown option %s\n",argv[p]); }
+      MPI_Finalize();
+      return 0;
+    }
+  }
+
+  my_edges = load_row_col_parallel(MPI_COMM_WORLD, argv[1], npes, 1, &n, &nedges, &my_nedges);
+  nrows = block_range(n, npes, proc_id, &first_row);
+  A = csr_from_edges(nrows, first_row, n, my_edges, my_nedges);
+  free(my_edges);
+  if(reorder != NULL){
+    // Renumber every link and send it to the owner of its new row
+    long long before = cut_links(MPI_COMM_WORLD, A, n);
+    int *renumber, r, k;
+    order = pr_order_graph(MPI_COMM_WORLD, A, n, reorder);
+    if(order == NULL){
+      if(proc_id == 0){ printf("unknown reordering %s\n",reorder); }
+      MPI_Finalize();
+      return 0;
+    }
+    renumber = pr_invert_order(order, n);
+    my_edges = malloc(2*(A->nnz > 0 ? A->nnz : 1) * sizeof(int));
+    for(r=0; r<A->nrows; r++){
+      for(k=A->rowptr[r]; k<A->rowptr[r+1]; k++){
+        my_edges[2*k] = renumber[A->first_row + r];
+        my_edges[2*k+1] = renumber[A->colind[k]];
+      }
+    }
+    my_edges = shuffle_edges(MPI_COMM_WORLD, my_edges, A->nnz, n, npes, 1, &my_nedges);
+    csr_free(A);
+    free(renumber);
+    A = csr_from_edges(nrows, first_row, n, my_edges, my_nedges);
+    free(my_edges);
+    long long after = cut_links(MPI_COMM_WORLD, A, n);
+    if(proc_id == 0){
+      printf("Links between processors' rows on %d processors: %lld before %s, %lld after\n",
+             npes,before,reorder,after);
+    }
+  }
+  outdeg = calloc(n, sizeof(int));
+  csr_col_counts(A, outdeg);
+  MPI_Allreduce(MPI_IN_PLACE, outdeg, n, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+  pr_write_binary(MPI_COMM_WORLD, argv[2], A, n, outdeg, nparts, order);
+  MPI_Allreduce(MPI_IN_PLACE, &A->nnz, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if(proc_id == 0){
+    printf("Wrote %s: %d rows, %d links from %lld lines\n",argv[2],n,A->nnz,nedges);
+  }
+
+  csr_free(A);
+  free(outdeg);
+  free(order);
+  MPI_Finalize();
+  return 0;
+}
@@ -0,0 +1,375 @@
+// Sparse link matrix for the pagerank programs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <pagerank.h>
+
+// One block of columns for the cache blocked product: the rows with
+// entries in the block and where those entries are in A's own colind
+// and val, so the entries are not copied
+typedef struct {
+  int nrows;                    // rows with entries in the block
+  int *rows;                    // which ones, in order
+  int *start;                   // rows[i]'s entries are start[i] .. end[i]-1 of A
+  int *end;
+  int *thread_first;            // thread t starts at rows[thread_first[t]]
+} csr_block_t;
+
+struct csr_plan {
+  int nthreads;
+  int *thread_rows;             // thread t works on rows thread_rows[t] .. thread_rows[t+1]-1
+  int nblocks;                  // column blocks, 0 if the columns are not blocked
+  csr_block_t *blocks;
+};
+
+static int compare_int(const void *a, const void *b){
+  int x = *(const int *) a, y = *(const int *) b;
+  return (x > y) - (x < y);
+}
+
+// Split the rows between the threads so each gets about the same
+// number of entries, counting every row as one more for its own
+// overhead. Lay out the column blocks if there is more than one.
+static csr_plan_t *make_plan(csr_t *A){
+  csr_plan_t *pl = malloc(sizeof(csr_plan_t));
+  long long work = A->nnz + A->nrows, done;
+  int t, r, b, k;
+
+  pl->nthreads = omp_get_max_threads();
+  pl->thread_rows = malloc((pl->nthreads+1) * sizeof(int));
+  pl->thread_rows[0] = 0;
+  for(t=1, r=0; t<pl->nthreads; t++){
+    done = A->rowptr[r] + r;
+    while(r < A->nrows && done*pl->nthreads < t*work){
+      r++;
+      done = A->rowptr[r] + r;
+    }
+    pl->thread_rows[t] = r;
+  }
+  pl->thread_rows[pl->nthreads] = A->nrows;
+
+#if PR_COL_BLOCK > 0
+  pl->nblocks = (A->ncols > PR_COL_BLOCK) ? (A->ncols + PR_COL_BLOCK-1) / PR_COL_BLOCK : 0;
+#else
+  pl->nblocks = 0;
+#endif
+  pl->blocks = malloc((pl->nblocks > 0 ? pl->nblocks : 1) * sizeof(csr_block_t));
+  int *pos = malloc((A->nrows > 0 ? A->nrows : 1) * sizeof(int));
+  memcpy(pos, A->rowptr, A->nrows * sizeof(int));
+  for(b=0; b<pl->nblocks; b++){//rows are sorted, so each row's entries in a block are the next run of them
+    csr_block_t *blk = &pl->blocks[b];
+    int last_col = (b+1)*PR_COL_BLOCK, n = 0;
+    for(r=0; r<A->nrows; r++){
+      for(k=pos[r]; k<A->rowptr[r+1] && A->colind[k] < last_col; k++);
+      n += (k > pos[r]);
+    }
+    blk->nrows = n;
+    blk->rows = malloc((n > 0 ? n : 1) * sizeof(int));
+    blk->start = malloc((n > 0 ? n : 1) * sizeof(int));
+    blk->end = malloc((n > 0 ? n : 1) * sizeof(int));
+    blk->thread_first = malloc((pl->nthreads+1) * sizeof(int));
+    n = 0;
+    for(t=0, r=0; r<A->nrows; r++){
+      while(t <= pl->nthreads && pl->thread_rows[t] <= r){//threads starting at or before this row
+        blk->thread_first[t++] = n;
+      }
+      for(k=pos[r]; k<A->rowptr[r+1] && A->colind[k] < last_col; k++);
+      if(k > pos[r]){
+        blk->rows[n] = r;
+        blk->start[n] = pos[r];
+        blk->end[n++] = k;
+      }
+      pos[r] = k;
+    }
+    for(; t<=pl->nthreads; t++){
+      blk->thread_first[t] = n;
+    }
+  }
+  free(pos);
+  return pl;
+}
+
+static void free_plan(csr_t *A){
+  int b;
+  if(A->plan == NULL){
+    return;
+  }
+  for(b=0; b<A->plan->nblocks; b++){
+    free(A->plan->blocks[b].rows);
+    free(A->plan->blocks[b].start);
+    free(A->plan->blocks[b].end);
+    free(A->plan->blocks[b].thread_first);
+  }
+  free(A->plan->blocks);
+  free(A->plan->thread_rows);
+  free(A->plan);
+  A->plan = NULL;
+}
+
+static csr_plan_t *get_plan(csr_t *A){
+  if(A->plan == NULL){
+    A->plan = make_plan(A);
+  }
+  return A->plan;
+}
+
+// y[rows[i]] = sum of entries start[i] .. end[i]-1 of A for i in
+// [lo,hi), or y[i] when rows is NULL, adding to y instead when add is
+// set. The ranks for the entries PR_PREFETCH ahead are prefetched
+// before each row so the scattered loads of x are already on their way.
+static void spmv_range(csr_t *A, const int *start, const int *end, const int *rows,
+                       int lo, int hi, const double *x, double *y, int add){
+  const int *colind = A->colind;
+  const double *val = A->val;
+  int i, k, r;
+  for(i=lo; i<hi; i++){
+    double sum = 0.0;
+    for(k=start[i]+PR_PREFETCH; k<end[i]+PR_PREFETCH && k<A->nnz; k++){
+      __builtin_prefetch(&x[colind[k]]);
+    }
+#pragma omp simd reduction(+:sum)
+    for(k=start[i]; k<end[i]; k++){
+      sum += val[k] * x[colind[k]];
+    }
+    r = (rows != NULL) ? rows[i] : i;
+    y[r] = add ? y[r] + sum : sum;
+  }
+}
+
+// Build the rows first_row .. first_row+nrows-1 of the matrix from
+// nedges (row,col) pairs, edges[2i] and edges[2i+1]. Every edge must
+// fall in those rows. Repeated edges count once. Entries start out as
+// 1.0.
+csr_t *csr_from_edges(int nrows, int first_row, int ncols, int *edges, int nedges){
+  csr_t *A = malloc(sizeof(csr_t));
+  int *fill = calloc(nrows+1, sizeof(int));
+  int *cols = malloc((nedges > 0 ? nedges : 1) * sizeof(int));
+  int i, r, k, nnz;
+
+  A->nrows = nrows;
+  A->ncols = ncols;
+  A->first_row = first_row;
+  A->plan = NULL;
+  A->rowptr = calloc(nrows+1, sizeof(int));
+  for(i=0; i<nedges; i++){//bucket the columns by row
+    A->rowptr[edges[2*i]-first_row+1]++;
+  }
+  for(r=0; r<nrows; r++){
+    A->rowptr[r+1] += A->rowptr[r];
+  }
+  for(i=0; i<nedges; i++){
+    r = edges[2*i]-first_row;
+    cols[A->rowptr[r] + fill[r]++] = edges[2*i+1];
+  }
+  nnz = 0;                      // sort each row and squeeze out repeats in place
+  for(r=0; r<nrows; r++){
+    int start = A->rowptr[r], end = A->rowptr[r+1];
+    qsort(&cols[start], end-start, sizeof(int), compare_int);
+    A->rowptr[r] = nnz;
+    for(k=start; k<end; k++){
+      if(k == start || cols[k] != cols[k-1]){
+        cols[nnz++] = cols[k];
+      }
+    }
+  }
+  A->rowptr[nrows] = nnz;
+  A->nnz = nnz;
+  A->colind = realloc(cols, (nnz > 0 ? nnz : 1) * sizeof(int));
+  A->val = malloc((nnz > 0 ? nnz : 1) * sizeof(double));
+  for(k=0; k<nnz; k++){
+    A->val[k] = 1.0;
+  }
+  free(fill);
+  return A;
+}
+
+void csr_free(csr_t *A){
+  free_plan(A);
+  free(A->rowptr);
+  free(A->colind);
+  free(A->val);
+  free(A);
+}
+
+// Add the number of entries in each column held here to counts, which
+// has ncols elements. Summed over every block of rows this is the out
+// degree of each page.
+void csr_col_counts(csr_t *A, int *counts){
+  int k;
+  for(k=0; k<A->nnz; k++){
+    counts[A->colind[k]]++;
+  }
+}
+
+// Scale every entry of column c by 1/outdeg[c] so each column sums to
+// one. Pages with no links have empty columns and are left alone.
+void csr_normalize(csr_t *A, int *outdeg){
+  int k;
+  for(k=0; k<A->nnz; k++){
+    A->val[k] = 1.0 / outdeg[A->colind[k]];
+  }
+}
+
+// y = A*x for the rows held here. x has ncols elements, y has nrows.
+// Threads take nnz balanced runs of rows. With column blocks each
+// thread goes through its rows once per block, so the reads of x stay
+// within one block's worth at a time.
+void csr_spmv(csr_t *A, double *x, double *y){
+  csr_plan_t *pl = get_plan(A);
+#pragma omp parallel num_threads(pl->nthreads)
+  {
+    int t, r, b;
+    for(t=omp_get_thread_num(); t<pl->nthreads; t+=omp_get_num_threads()){
+      if(pl->nblocks == 0){
+        spmv_range(A, A->rowptr, A->rowptr+1, NULL, pl->thread_rows[t], pl->thread_rows[t+1], x, y, 0);
+        continue;
+      }
+      for(r=pl->thread_rows[t]; r<pl->thread_rows[t+1]; r++){
+        y[r] = 0.0;
+      }
+      for(b=0; b<pl->nblocks; b++){
+        csr_block_t *blk = &pl->blocks[b];
+        spmv_range(A, blk->start, blk->end, blk->rows,
+                   blk->thread_first[t], blk->thread_first[t+1], x, y, 1);
+      }
+    }
+  }
+}
+
+// y[rows[i]] = (A*x)[rows[i]] for the nrows_active rows listed, the
+// other entries of y are left alone
+void csr_spmv_rows(csr_t *A, double *x, double *y, int *rows, int nrows_active){
+  int i,r,k;
+#pragma omp parallel for private(r,k) schedule(static)
+  for(i=0; i<nrows_active; i++){
+    double sum = 0.0;
+    r = rows[i];
+    for(k=A->rowptr[r]; k<A->rowptr[r+1]; k++){
+      sum += A->val[k] * x[A->colind[k]];
+    }
+    y[r] = sum;
+  }
+}
+
+// One Gauss-Seidel sweep over the rows held here for x = scale*A*x +
+// shift: in row order solve row r for x[first_row+r], so later rows
+// already see the new values of earlier ones. A page linking to itself
+// has its own entry moved to the left hand side. x has ncols elements
+// and is updated in place.
+void csr_gs_sweep(csr_t *A, double *x, double scale, double shift){
+  int r,k,c;
+  for(r=0; r<A->nrows; r++){
+    double sum = 0.0, diag = 0.0;
+    c = A->first_row + r;
+    for(k=A->rowptr[r]; k<A->rowptr[r+1]; k++){
+      if(A->colind[k] == c){
+        diag += A->val[k];
+      }
+      else{
+        sum += A->val[k] * x[A->colind[k]];
+      }
+    }
+    x[c] = (scale*sum + shift) / (1.0 - scale*diag);
+  }
+}
+
+// Y = A*X for k vectors stored interleaved, element c of vector j at
+// X[c*k+j]. X has ncols*k elements, Y has nrows*k. Each entry of A is
+// loaded once and used for all k vectors.
+void csr_spmm(csr_t *A, double *X, double *Y, int k){
+  csr_plan_t *pl = get_plan(A);
+#pragma omp parallel num_threads(pl->nthreads)
+  {
+    int t, r, e, j;
+    for(t=omp_get_thread_num(); t<pl->nthreads; t+=omp_get_num_threads()){
+      for(r=pl->thread_rows[t]; r<pl->thread_rows[t+1]; r++){
+        double *y = &Y[r*k];
+        for(j=0; j<k; j++){
+          y[j] = 0.0;
+        }
+        for(e=A->rowptr[r]; e<A->rowptr[r+1]; e++){
+          const double v = A->val[e];
+          const double *x = &X[A->colind[e]*k];
+#pragma omp simd
+          for(j=0; j<k; j++){
+            y[j] += v * x[j];
+          }
+        }
+      }
+    }
+  }
+}
+
+// Apply ndelta edge changes to the rows held here before normalizing.
+// Change i is delta[3i] = +1 to add the edge (delta[3i+1],delta[3i+2])
+// or -1 to remove it, applied in order. Changes to other rows are
+// skipped. applied[i] is set to +1 or -1 when change i added or removed
+// an entry and 0 otherwise, so the out degrees can be patched with
+// applied summed over every block of rows.
+void csr_apply_delta(csr_t *A, int *delta, int ndelta, int *applied){
+  int *first = calloc(A->nrows+1, sizeof(int));
+  int *order = malloc((ndelta > 0 ? ndelta : 1) * sizeof(int));
+  int *fill = calloc(A->nrows+1, sizeof(int));
+  int *rowptr, *colind;
+  int i, j, r, k, c, nnz, len;
+
+  for(i=0; i<ndelta; i++){//bucket the changes by row, keeping their order
+    r = delta[3*i+1] - A->first_row;
+    applied[i] = 0;
+    if(r >= 0 && r < A->nrows){
+      first[r+1]++;
+    }
+  }
+  for(r=0; r<A->nrows; r++){
+    first[r+1] += first[r];
+  }
+  for(i=0; i<ndelta; i++){
+    r = delta[3*i+1] - A->first_row;
+    if(r >= 0 && r < A->nrows){
+      order[first[r] + fill[r]++] = i;
+    }
+  }
+
+  rowptr = malloc((A->nrows+1) * sizeof(int));
+  colind = malloc((A->nnz + first[A->nrows] + 1) * sizeof(int));
+  nnz = 0;
+  for(r=0; r<A->nrows; r++){
+    rowptr[r] = nnz;
+    len = A->rowptr[r+1] - A->rowptr[r];
+    memcpy(&colind[nnz], &A->colind[A->rowptr[r]], len * sizeof(int));
+    for(j=first[r]; j<first[r+1]; j++){
+      i = order[j];
+      c = delta[3*i+2];
+      for(k=0; k<len && colind[nnz+k] != c; k++);
+      if(delta[3*i] > 0 && k == len){
+        colind[nnz + len++] = c;
+        applied[i] = 1;
+      }
+      else if(delta[3*i] < 0 && k < len){
+        colind[nnz+k] = colind[nnz + --len];
+        applied[i] = -1;
+      }
+    }
+    if(first[r+1] > first[r]){
+      qsort(&colind[nnz], len, sizeof(int), compare_int);
+    }
+    nnz += len;
+  }
+  rowptr[A->nrows] = nnz;
+  free_plan(A);
+  free(A->rowptr);
+  free(A->colind);
+  free(A->val);
+  A->rowptr = rowptr;
+  A->colind = realloc(colind, (nnz > 0 ? nnz : 1) * sizeof(int));
+  A->nnz = nnz;
+  A->val = malloc((nnz > 0 ? nnz : 1) * sizeof(double));
+  for(k=0; k<nnz; k++){
+    A->val[k] = 1.0;
+  }
+  free(first);
+  free(order);
+  free(fill);
+}
@@ -0,0 +1,222 @@
+// Output for the pagerank programs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include <pagerank.h>
+
+static void print_status(FILE *out, double change, double tol){
+  if(change < tol){
+    fprintf(out,"CONVERGED\n");
+  }
+  else{
+    fprintf(out,"MAX ITERATION REACHED\n");
+  }
+}
+
+// Print whether the iteration converged and every page's rank, one per
+// line
+void pr_print_ranks(FILE *out, double change, double tol, double *ranks, int n){
+  int r;
+  print_status(out, change, tol);
+  fprintf(out,"\nPAGE RANKS\n");
+  for(r=0; r<n; r++){
+    fprintf(out,"%.8f\n",ranks[r]);
+  }
+}
+
+// A page and its rank, laid out as MPI_DOUBLE_INT
+typedef struct {
+  double rank;
+  int page;
+} ranked_t;
+
+// a comes before b in the top list: higher rank, lower page on a tie
+static int before(const ranked_t *a, const ranked_t *b){
+  return a->rank > b->rank || (a->rank == b->rank && a->page < b->page);
+}
+
+// Merge two top lists of k pages each, best first and padded with page
+// -1, into inout. k comes from the size of the type, one list per
+// element.
+static void merge_top(void *in, void *inout, int *len, MPI_Datatype *type){
+  ranked_t *a = in, *b = inout, *m;
+  int size, k, e, i, j, t;
+  MPI_Type_size(*type, &size);
+  k = size / (sizeof(double) + sizeof(int));
+  m = malloc(k * sizeof(ranked_t));
+  for(e=0; e<*len; e++, a+=k, b+=k){
+    for(t=0, i=0, j=0; t<k; t++){
+      if(b[j].page < 0 || (a[i].page >= 0 && before(&a[i], &b[j]))){
+        m[t] = a[i++];
+      }
+      else{
+        m[t] = b[j++];
+      }
+    }
+    memcpy(b, m, k * sizeof(ranked_t));
+  }
+  free(m);
+}
+
+// Sift the smallest of the heap of n down from i, so heap[0] is always
+// the page that drops out first
+static void sift_down(ranked_t *heap, int n, int i){
+  ranked_t v = heap[i];
+  int c;
+  for(; (c = 2*i+1) < n; i=c){
+    if(c+1 < n && before(&heap[c], &heap[c+1])){
+      c++;
+    }
+    if(!before(&v, &heap[c])){
+      break;
+    }
+    heap[i] = heap[c];
+  }
+  heap[i] = v;
+}
+
+static int compare_ranked(const void *a, const void *b){
+  return before(b, a) - before(a, b);
+}
+
+// Collectively print whether the iteration converged and the k pages
+// with the highest ranks, from the nrows held here starting at
+// first_row. Each proc keeps its best k in a heap, then the lists are
+// merged up a reduction tree to the root, so no proc sees more than 2k
+// of the n ranks. order gives the old page numbers if the pages were
+// renumbered, and is NULL otherwise.
+void pr_print_top(MPI_Comm comm, FILE *out, double change, double tol, double *ranks,
+                  int first_row, int nrows, int *order, int k){
+  ranked_t *top = malloc(k * sizeof(ranked_t)), *all = malloc(k * sizeof(ranked_t));
+  MPI_Datatype list;
+  MPI_Op op;
+  int proc_id, r, i, m = 0;
+  ranked_t v;
+
+  MPI_Comm_rank(comm, &proc_id);
+  for(r=0; r<nrows; r++){
+    v.rank = ranks[first_row + r];
+    v.page = (order != NULL) ? order[first_row + r] : first_row + r;
+    if(m < k){//fill the heap, then only something better replaces its smallest
+      top[m++] = v;
+      if(m == k){
+        for(i=k/2-1; i>=0; i--){
+          sift_down(top, k, i);
+        }
+      }
+    }
+    else if(before(&v, &top[0])){
+      top[0] = v;
+      sift_down(top, k, 0);
+    }
+  }
+  qsort(top, m, sizeof(ranked_t), compare_ranked);
+  for(i=m; i<k; i++){
+    top[i].rank = 0.0;
+    top[i].page = -1;
+  }
+
+  MPI_Type_contiguous(k, MPI_DOUBLE_INT, &list);
+  MPI_Type_commit(&list);
+  MPI_Op_create(merge_top, 1, &op);
+  MPI_Reduce(top, all, 1, list, op, 0, comm);
+  if(proc_id == 0){
+    print_status(out, change, tol);
+    fprintf(out,"\nTOP %d PAGES\n",k);
+    for(i=0; i<k && all[i].page >= 0; i++){
+      fprintf(out,"%d %.8f\n",all[i].page,all[i].rank);
+    }
+  }
+  MPI_Op_free(&op);
+  MPI_Type_free(&list);
+  free(top);
+  free(all);
+}
+
+// Per iteration trace of the change, the norm and the seconds each
+// phase took, max and average over the processors, so a slow iteration
+// or a processor holding the others up shows. Written by the root as
+// JSON if the file name ends in .json and as CSV otherwise.
+struct pr_trace {
+  MPI_Comm comm;
+  int proc_id;
+  int npes;
+  int nphases;
+  const char **names;
+  FILE *out;                    // root only
+  int json;
+  int lines;                    // iterations written so far
+};
+
+pr_trace_t *pr_trace_open(MPI_Comm comm, char *fname, int nphases, const char **names){
+  pr_trace_t *tr = malloc(sizeof(pr_trace_t));
+  size_t len = strlen(fname);
+  int i;
+  tr->comm = comm;
+  MPI_Comm_rank(comm, &tr->proc_id);
+  MPI_Comm_size(comm, &tr->npes);
+  tr->nphases = (nphases < PR_TRACE_MAX) ? nphases : PR_TRACE_MAX;
+  tr->names = names;
+  tr->json = (len >= 5 && strcmp(&fname[len-5],".json") == 0);
+  tr->lines = 0;
+  tr->out = NULL;
+  if(tr->proc_id == 0){
+    tr->out = fopen(fname,"w");
+    if(tr->out == NULL){
+      perror(fname);
+      MPI_Abort(comm, 1);
+    }
+    if(tr->json){
+      fprintf(tr->out,"[");
+    }
+    else{
+      fprintf(tr->out,"iter,diff,norm");
+      for(i=0; i<tr->nphases; i++){
+        fprintf(tr->out,",%s_max,%s_avg",names[i],names[i]);
+      }
+      fprintf(tr->out,"\n");
+    }
+  }
+  return tr;
+}
+
+// Record iteration iter, secs holds this processor's seconds in each
+// phase during it. Collective over the trace's processors.
+void pr_trace_iter(pr_trace_t *tr, int iter, double change, double norm, double *secs){
+  double hi[PR_TRACE_MAX], sum[PR_TRACE_MAX];
+  int i;
+  MPI_Reduce(secs, hi, tr->nphases, MPI_DOUBLE, MPI_MAX, 0, tr->comm);
+  MPI_Reduce(secs, sum, tr->nphases, MPI_DOUBLE, MPI_SUM, 0, tr->comm);
+  if(tr->proc_id != 0){
+    return;
+  }
+  if(tr->json){
+    fprintf(tr->out,"%s\n  {\"iter\": %d, \"diff\": %.6e, \"norm\": %.10g",
+            (tr->lines > 0) ? "," : "",iter,change,norm);
+    for(i=0; i<tr->nphases; i++){
+      fprintf(tr->out,", \"%s_max\": %.6e, \"%s_avg\": %.6e",
+              tr->names[i],hi[i],tr->names[i],sum[i]/tr->npes);
+    }
+    fprintf(tr->out,"}");
+  }
+  else{
+    fprintf(tr->out,"%d,%.6e,%.10g",iter,change,norm);
+    for(i=0; i<tr->nphases; i++){
+      fprintf(tr->out,",%.6e,%.6e",hi[i],sum[i]/tr->npes);
+    }
+    fprintf(tr->out,"\n");
+  }
+  tr->lines++;
+}
+
+void pr_trace_close(pr_trace_t *tr){
+  if(tr->proc_id == 0){
+    if(tr->json){
+      fprintf(tr->out,"\n]\n");
+    }
+    fclose(tr->out);
+  }
+  free(tr);
+}
@@ -0,0 +1,311 @@
+// Parallel loading of row/col edge files for the pagerank programs.
+// Every processor reads its own byte range of the file with MPI-IO,
+// parses the lines that start in it, and sends each edge on to the
+// processor owning its row, so no processor ever holds the whole graph.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <mpi.h>
+#include <pagerank.h>
+
+#define HEADER_LEN 256                // longest first line we look for
+#define LINE_LEN 256                  // longest edge line, the read runs this far past the range
+#define READ_PIECE INT_MAX            // most bytes in one read, MPI counts are ints
+
+// Which processor holds row r when n rows are split into nearly equal
+// blocks, the first n%npes procs getting an extra row
+int row_owner(int r, int n, int npes){
+  int base = n/npes, surplus = n%npes;
+  if(r < surplus*(base+1)){
+    return r/(base+1);
+  }
+  return surplus + (r - surplus*(base+1))/base;
+}
+
+// Size of block b when n rows are split as in row_owner, start is set
+// to its first row
+int block_range(int n, int nblocks, int b, int *start){
+  int base = n/nblocks, surplus = n%nblocks;
+  *start = b*base + (b < surplus ? b : surplus);
+  return base + (b < surplus ? 1 : 0);
+}
+
+// Which processor gets edge (r,c) of an n x n matrix split into prow by
+// pcol blocks
+static int edge_owner(int r, int c, int n, int prow, int pcol){
+  return row_owner(r, n, prow)*pcol + row_owner(c, n, pcol);
+}
+
+// Root reads the "nrows nnz" line and everyone learns it along with
+// where the edge lines start
+static void read_header(MPI_File fh, MPI_Comm comm, char *fname, int *nrows, long long *nnz,
+                        MPI_Offset *body){
+  int proc_id;
+  long long info[3] = {0, 0, -1};
+  MPI_Comm_rank(comm, &proc_id);
+  if(proc_id == 0){
+    char buf[HEADER_LEN+1];
+    MPI_Status status;
+    int got, len;
+    MPI_File_read_at(fh, 0, buf, HEADER_LEN, MPI_CHAR, &status);
+    MPI_Get_count(&status, MPI_CHAR, &got);
+    buf[got] = '\0';
+    char *eol = strchr(buf, '\n');
+    int r, z;
+    if(eol != NULL && sscanf(buf, "%d %d%n", &r, &z, &len) == 2 && len <= eol-buf){
+      info[0] = r;
+      info[1] = z;
+      info[2] = eol-buf+1;
+    }
+  }
+  MPI_Bcast(info, 3, MPI_LONG_LONG, 0, comm);
+  if(info[2] < 0){
+    if(proc_id == 0){
+      fprintf(stderr,"ERROR: %s does not start with the number of rows and nonzeros\n",fname);
+    }
+    MPI_Abort(comm, 1);
+  }
+  *nrows = info[0];
+  *nnz = info[1];
+  *body = info[2];
+}
+
+// Skip spaces and tabs but not the end of the line
+static char *skip_blanks(char *p){
+  while(*p == ' ' || *p == '\t' || *p == '\r'){
+    p++;
+  }
+  return p;
+}
+
+// Parse the "row col" lines starting in buf[from,to). buf holds the
+// bytes from file offset base on and is null terminated past the end
+// of the last line. Puts the pairs in edges, returns how many.
+static int parse_lines(char *buf, MPI_Offset from, MPI_Offset to, int *edges, int nrows,
+                       MPI_Offset base, char *fname, MPI_Comm comm){
+  char *p = &buf[from], *end;
+  size_t n = 0;
+  long row = -1, col = -1;
+  while(p < &buf[to]){
+    p = skip_blanks(p);
+    if(*p == '\n'){//blank line
+      p++;
+      continue;
+    }
+    if(*p == '\0'){
+      break;
+    }
+    row = strtol(p, &end, 10);
+    if(end != p){
+      p = skip_blanks(end);
+      col = strtol(p, &end, 10);
+    }
+    if(end == p || row < 0 || col < 0 || row >= nrows || col >= nrows){
+      fprintf(stderr,"ERROR: bad row/col near byte %lld of %s for matrix with rows/cols %d %d\n",
+              (long long) (base + (p-buf)),fname,nrows,nrows);
+      MPI_Abort(comm, 1);
+    }
+    edges[2*n] = row;
+    edges[2*n+1] = col;
+    n++;
+    p = end;
+    while(*p != '\0' && *p != '\n'){
+      p++;
+    }
+    if(*p == '\n'){
+      p++;
+    }
+  }
+  return n;
+}
+
+// Send each of the nedges row,col pairs in edges to the processor
+// owning its block of an n x n matrix split into prow by pcol blocks.
+// Frees edges and returns the pairs this processor owns, my_nedges of
+// them.
+int *shuffle_edges(MPI_Comm comm, int *edges, int nedges, int n, int prow, int pcol,
+                   int *my_nedges){
+  int npes, i, total;
+  int *out, *fill, *my_edges;
+  int *scounts, *sdispls, *rcounts, *rdispls;
+
+  MPI_Comm_size(comm, &npes);
+  scounts = calloc(npes, sizeof(int));
+  sdispls = malloc(npes * sizeof(int));
+  rcounts = malloc(npes * sizeof(int));
+  rdispls = malloc(npes * sizeof(int));
+  fill = calloc(npes, sizeof(int));
+  for(i=0; i<nedges; i++){
+    scounts[edge_owner(edges[2*i], edges[2*i+1], n, prow, pcol)] += 2;
+  }
+  for(i=0; i<npes; i++){
+    sdispls[i] = (i==0) ? 0 : sdispls[i-1]+scounts[i-1];
+  }
+  out = malloc(2*(nedges > 0 ? nedges : 1) * sizeof(int));
+  for(i=0; i<nedges; i++){
+    int p = edge_owner(edges[2*i], edges[2*i+1], n, prow, pcol);
+    out[sdispls[p] + fill[p]++] = edges[2*i];
+    out[sdispls[p] + fill[p]++] = edges[2*i+1];
+  }
+  free(edges);
+  MPI_Alltoall(scounts, 1, MPI_INT, rcounts, 1, MPI_INT, comm);
+  for(i=0; i<npes; i++){
+    rdispls[i] = (i==0) ? 0 : rdispls[i-1]+rcounts[i-1];
+  }
+  // The ints received are counted in an int, so a proc whose rows hold
+  // over INT_MAX/2 links needs more procs
+  long long want = 0;
+  for(i=0; i<npes; i++){
+    want += rcounts[i];
+  }
+  if(want > INT_MAX){
+    fprintf(stderr,"ERROR: %lld links for one processor, at most %d, use more processors\n",
+            want/2, INT_MAX/2);
+    MPI_Abort(comm, 1);
+  }
+  total = rdispls[npes-1] + rcounts[npes-1];
+  my_edges = malloc((total > 0 ? total : 1) * sizeof(int));
+  MPI_Alltoallv(out, scounts, sdispls, MPI_INT, my_edges, rcounts, rdispls, MPI_INT, comm);
+  *my_nedges = total/2;
+
+  free(out);
+  free(fill);
+  free(scounts);
+  free(sdispls);
+  free(rcounts);
+  free(rdispls);
+  return my_edges;
+}
+
+// Collectively load a row/col edge file. The file starts with the
+// number of rows and nonzeros on the first line, then has one "row col"
+// line per nonzero whose value is assumed to be 1.0. The nonzero count
+// is only a hint. Sets nrows and the number of edge lines actually in
+// the file, and returns this processor's edges as row,col pairs,
+// my_nedges of them.
+//
+// The matrix is split into prow blocks of rows by pcol blocks of
+// columns as in row_owner, and processor i*pcol+j gets the edges in
+// block (i,j). pcol is 1 for the usual split by rows.
+int *load_row_col_parallel(MPI_Comm comm, char *fname, int prow, int pcol,
+                           int *nrows, long long *nnz, int *my_nedges){
+  MPI_File fh;
+  MPI_Offset size, body, chunk, start, stop, rd_start, rd_len, from, to, off;
+  int proc_id, npes, err, nread, total, npieces, k;
+  char *buf;
+  int *edges;
+
+  MPI_Comm_rank(comm, &proc_id);
+  MPI_Comm_size(comm, &npes);
+  err = MPI_File_open(comm, fname, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+  if(err != MPI_SUCCESS){
+    if(proc_id == 0){
+      fprintf(stderr,"ERROR: could not open %s for reading\n",fname);
+    }
+    MPI_Abort(comm, 1);
+  }
+  MPI_File_get_size(fh, &size);
+  read_header(fh, comm, fname, nrows, nnz, &body);
+
+  // This proc parses the lines that start in [start,stop). It reads
+  // from one byte before to see if start begins a line, and a line's
+  // worth past stop to finish its last one.
+  chunk = (size - body + npes-1) / npes;
+  start = body + proc_id*chunk;
+  stop = start + chunk;
+  start = (start < size) ? start : size;
+  stop = (stop < size) ? stop : size;
+  rd_start = (start > body) ? start-1 : body;
+  rd_len = stop - rd_start + LINE_LEN;
+  if(rd_start + rd_len > size){
+    rd_len = size - rd_start;
+  }
+  buf = malloc(rd_len + 1);
+  // A range over 2 GiB is read a piece at a time. The reads are
+  // collective, so everyone makes as many as the proc with the most.
+  npieces = (rd_len + READ_PIECE-1) / READ_PIECE;
+  MPI_Allreduce(MPI_IN_PLACE, &npieces, 1, MPI_INT, MPI_MAX, comm);
+  for(k=0; k<npieces; k++){
+    off = (MPI_Offset) k*READ_PIECE;
+    off = (off < rd_len) ? off : rd_len;
+    MPI_File_read_at_all(fh, rd_start+off, &buf[off],
+                         (rd_len-off < READ_PIECE) ? (int) (rd_len-off) : READ_PIECE,
+                         MPI_CHAR, MPI_STATUS_IGNORE);
+  }
+  MPI_File_close(&fh);
+  buf[rd_len] = '\0';
+
+  from = start - rd_start;
+  to = stop - rd_start;
+  if(start > body && buf[0] != '\n'){//start is mid line, its owner is the proc before
+    while(from < to && buf[from-1] != '\n'){
+      from++;
+    }
+  }
+  // A line holds at least 4 bytes, "r c\n"
+  edges = malloc(2*((to-from)/4 + 1) * sizeof(int));
+  nread = parse_lines(buf, from, to, edges, *nrows, rd_start, fname, comm);
+  free(buf);
+  MPI_Allreduce(&nread, &total, 1, MPI_INT, MPI_SUM, comm);
+  *nnz = total;
+
+  return shuffle_edges(comm, edges, nread, *nrows, prow, pcol, my_nedges);
+}
+
+// Root reads an edge change file, one change per line as "+ row col"
+// to add a link or "- row col" to remove one, skipping blank lines and
+// lines starting with #. Everyone gets the changes in order as
+// op,row,col triples with op +1 or -1, ndelta of them.
+int *read_delta(MPI_Comm comm, char *fname, int n, int *ndelta){
+  int proc_id, size = 64, ok = 1, lineno = 0;
+  int *delta = NULL;
+  MPI_Comm_rank(comm, &proc_id);
+  *ndelta = 0;
+  if(proc_id == 0){
+    FILE *f = fopen(fname,"r");
+    char line[LINE_LEN], op;
+    int row, col;
+    if(f == NULL){
+      perror(fname);
+      ok = 0;
+    }
+    delta = malloc(3*size * sizeof(int));
+    while(ok && fgets(line, LINE_LEN, f) != NULL){
+      lineno++;
+      char *p = skip_blanks(line);
+      if(*p == '#' || *p == '\n' || *p == '\0'){
+        continue;
+      }
+      if(sscanf(p, "%c %d %d", &op, &row, &col) != 3 || (op != '+' && op != '-') ||
+         row < 0 || col < 0 || row >= n || col >= n){
+        fprintf(stderr,"ERROR: bad change on line %d of %s for matrix with rows/cols %d %d\n",
+                lineno,fname,n,n);
+        ok = 0;
+        break;
+      }
+      if(*ndelta == size){
+        size *= 2;
+        delta = realloc(delta, 3*size * sizeof(int));
+      }
+      delta[3 * *ndelta] = (op == '+') ? 1 : -1;
+      delta[3 * *ndelta + 1] = row;
+      delta[3 * *ndelta + 2] = col;
+      (*ndelta)++;
+    }
+    if(f != NULL){
+      fclose(f);
+    }
+  }
+  MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+  if(!ok){
+    MPI_Abort(comm, 1);
+  }
+  MPI_Bcast(ndelta, 1, MPI_INT, 0, comm);
+  if(proc_id != 0){
+    delta = malloc(3*(*ndelta > 0 ? *ndelta : 1) * sizeof(int));
+  }
+  MPI_Bcast(delta, 3 * *ndelta, MPI_INT, 0, comm);
+  return delta;
+}
@@ -0,0 +1,124 @@
+// Pattern only storage of the link matrix. Before normalizing every
+// entry is 1.0 and afterwards every entry of column c is 1/outdeg[c],
+// so the values say nothing the out degrees do not. Only the columns
+// are kept, each row's as the gaps between them in a varint: 7 bits a
+// byte, the high bit set on every byte but the last. Sorted rows make
+// the gaps small, a single byte for most links once pr_convert has
+// numbered linked pages together, against an int and a double for
+// each link in CSR.
+//
+// The product reads the ranks scaled by 1/outdeg once per iteration,
+// n reads, so each link is a decode and an add. The power step is
+// fused around it: the new rank, its change and the sums for the next
+// teleport share are worked out as each row finishes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include <pagerank.h>
+
+static int varint_bytes(unsigned int v){
+  int len = 1;
+  for(; v >= 0x80; v >>= 7){
+    len++;
+  }
+  return len;
+}
+
+static unsigned char *put_varint(unsigned char *p, unsigned int v){
+  for(; v >= 0x80; v >>= 7){
+    *p++ = (v & 0x7f) | 0x80;
+  }
+  *p++ = v;
+  return p;
+}
+
+// Pack the columns of A with the out degrees of all ncols pages. Each
+// row's first column is stored as its gap from 0.
+pr_pattern_t *pattern_from_csr(csr_t *A, int *outdeg){
+  pr_pattern_t *P = malloc(sizeof(pr_pattern_t));
+  unsigned char *p;
+  int r, k, c;
+
+  P->nrows = A->nrows;
+  P->ncols = A->ncols;
+  P->first_row = A->first_row;
+  P->nnz = A->nnz;
+  P->rowptr = malloc((A->nrows+1) * sizeof(long long));
+  P->rowptr[0] = 0;
+  for(r=0; r<A->nrows; r++){
+    P->rowptr[r+1] = P->rowptr[r];
+    for(k=A->rowptr[r], c=0; k<A->rowptr[r+1]; c=A->colind[k++]){
+      P->rowptr[r+1] += varint_bytes(A->colind[k] - c);
+    }
+  }
+  P->gaps = malloc(P->rowptr[A->nrows] > 0 ? P->rowptr[A->nrows] : 1);
+  p = P->gaps;
+  for(r=0; r<A->nrows; r++){
+    for(k=A->rowptr[r], c=0; k<A->rowptr[r+1]; c=A->colind[k++]){
+      p = put_varint(p, A->colind[k] - c);
+    }
+  }
+  P->inv_outdeg = malloc((A->ncols > 0 ? A->ncols : 1) * sizeof(double));
+  P->scaled = malloc((A->ncols > 0 ? A->ncols : 1) * sizeof(double));
+  for(c=0; c<A->ncols; c++){//pages with no links have empty columns, 0 marks them
+    P->inv_outdeg[c] = (outdeg[c] > 0) ? 1.0 / outdeg[c] : 0.0;
+  }
+  return P;
+}
+
+void pattern_free(pr_pattern_t *P){
+  free(P->rowptr);
+  free(P->gaps);
+  free(P->inv_outdeg);
+  free(P->scaled);
+  free(P);
+}
+
+// Bytes of the matrix per link, for comparing with CSR. The per page
+// arrays are left out, they are read once a step like the ranks.
+double pattern_bytes_per_link(pr_pattern_t *P){
+  long long bytes = P->rowptr[P->nrows] + (P->nrows+1)*sizeof(long long);
+  return P->nnz > 0 ? (double) bytes / P->nnz : 0.0;
+}
+
+// One power step for the rows held here: y[r] = damping*(A*x)[r] +
+// teleport, where x has all ncols ranks. sums gets this proc's change
+// from x, the sum of y and the teleport share of y, as the power
+// method adds them up.
+void pattern_power_step(pr_pattern_t *P, double *x, double *y, double damping, double teleport,
+                        double *sums){
+  const double *xs = P->scaled;
+  double change = 0.0, norm = 0.0, share = 0.0;
+  int r, c;
+
+#pragma omp parallel for schedule(static)
+  for(c=0; c<P->ncols; c++){
+    P->scaled[c] = x[c] * P->inv_outdeg[c];
+  }
+#pragma omp parallel for private(c) reduction(+:change,norm,share) schedule(static)
+  for(r=0; r<P->nrows; r++){
+    const unsigned char *p = &P->gaps[P->rowptr[r]], *end = &P->gaps[P->rowptr[r+1]];
+    double sum = 0.0, diff;
+    unsigned int v, b;
+    int shift;
+    for(c=0; p<end; ){
+      b = *p++;
+      v = b & 0x7f;
+      for(shift=7; b & 0x80; shift+=7){
+        b = *p++;
+        v |= (b & 0x7f) << shift;
+      }
+      c += v;
+      sum += xs[c];
+    }
+    y[r] = damping*sum + teleport;
+    diff = y[r] - x[P->first_row + r];
+    change += diff>0 ? diff : -diff;
+    norm += y[r];
+    share += (P->inv_outdeg[P->first_row + r] == 0.0) ? y[r] : (1.0-damping)*y[r];
+  }
+  sums[0] = change;
+  sums[1] = norm;
+  sums[2] = share;
+}
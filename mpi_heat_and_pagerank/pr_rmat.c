@@ -0,0 +1,225 @@
+// R-MAT graph generator for pagerank scaling runs. A graph of 2^scale
+// pages and edgefactor links per page is built by dropping each link
+// into one quadrant of the matrix after another, with probabilities
+// a, b, c and 1-a-b-c, down to a single entry, which gives the skewed
+// degrees of real link graphs. The page numbers are then scrambled so
+// the hubs do not all land in the first processor's rows.
+//
+// Link e is drawn from its own random stream, seeded from the seed and
+// e, so each processor makes its share of the links independently and
+// the graph is the same on any number of processors. It is written as
+// a row/col text file, or as a binary graph like pr_convert's when the
+// output name ends in .bin. Repeated links are left in the text and
+// dropped from the binary.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <mpi.h>
+#include <pagerank.h>
+
+#define RMAT_CHUNK (1<<20)            // links formatted per write of the text file
+
+typedef struct {
+  int scale;
+  double a, b, c;
+  unsigned long long seed;
+} rmat_t;
+
+static unsigned long long splitmix64(unsigned long long *state){
+  unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Row and column of link e
+static void rmat_edge(rmat_t *g, long long e, int *row, int *col){
+  unsigned long long state = g->seed ^ (e * 0xd1b54a32d192ed03ULL);
+  unsigned int mask = (1u << g->scale) - 1;
+  int r = 0, c = 0, level;
+  double u;
+  splitmix64(&state);           // mix the seed and e before the first draw
+  for(level=0; level<g->scale; level++){
+    u = (splitmix64(&state) >> 11) * (1.0 / 9007199254740992.0);
+    r <<= 1;
+    c <<= 1;
+    if(u >= g->a + g->b + g->c){
+      r |= 1;
+      c |= 1;
+    }
+    else if(u >= g->a + g->b){
+      r |= 1;
+    }
+    else if(u >= g->a){
+      c |= 1;
+    }
+  }
+  // Multiplying by an odd number is a bijection on scale bit numbers
+  *row = (int) (((unsigned int) r * 0x9e3779b1u + (unsigned int) g->seed) & mask);
+  *col = (int) (((unsigned int) c * 0x9e3779b1u + (unsigned int) g->seed) & mask);
+}
+
+static int digits(int v){
+  int d = 1;
+  for(; v >= 10; v /= 10){
+    d++;
+  }
+  return d;
+}
+
+// Write the links first .. first+count-1 of every proc to fname as
+// text. The bytes each proc writes are worked out in a first pass so
+// the procs know where to start, then the links are drawn again and
+// written a chunk at a time.
+static void write_text(MPI_Comm comm, char *fname, rmat_t *g, long long nedges,
+                       long long first, long long count){
+  MPI_File fh;
+  char header[64], *buf = malloc(RMAT_CHUNK * 24);
+  long long e, bytes = 0, offset = 0;
+  int proc_id, hlen, len, r, c, err;
+
+  MPI_Comm_rank(comm, &proc_id);
+  hlen = snprintf(header, sizeof(header), "%d %lld\n", 1 << g->scale, nedges);
+  for(e=first; e<first+count; e++){
+    rmat_edge(g, e, &r, &c);
+    bytes += digits(r) + digits(c) + 2;
+  }
+  MPI_Exscan(&bytes, &offset, 1, MPI_LONG_LONG, MPI_SUM, comm);
+  offset = (proc_id == 0) ? hlen : offset + hlen;
+
+  err = MPI_File_open(comm, fname, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+  if(err != MPI_SUCCESS){
+    if(proc_id == 0){
+      fprintf(stderr,"ERROR: could not open %s for writing\n",fname);
+    }
+    MPI_Abort(comm, 1);
+  }
+  MPI_File_set_size(fh, 0);
+  if(proc_id == 0){
+    MPI_File_write_at(fh, 0, header, hlen, MPI_CHAR, MPI_STATUS_IGNORE);
+  }
+  for(e=first; e<first+count; ){
+    for(len=0; len < (RMAT_CHUNK-1)*24 && e<first+count; e++){
+      rmat_edge(g, e, &r, &c);
+      len += sprintf(&buf[len], "%d %d\n", r, c);
+    }
+    MPI_File_write_at(fh, offset, buf, len, MPI_CHAR, MPI_STATUS_IGNORE);
+    offset += len;
+  }
+  MPI_File_close(&fh);
+  free(buf);
+}
+
+// Build the link matrix from every proc's links and write it as a
+// binary graph
+static void write_binary(MPI_Comm comm, char *fname, rmat_t *g, long long first, long long count,
+                         int nparts, long long *nnz){
+  int npes, proc_id, n = 1 << g->scale, nrows, first_row, my_nedges, k;
+  int *edges = malloc(2*(count > 0 ? count : 1) * sizeof(int)), *outdeg;
+  long long e;
+  csr_t *A;
+
+  MPI_Comm_size(comm, &npes);
+  MPI_Comm_rank(comm, &proc_id);
+  for(e=0; e<count; e++){
+    rmat_edge(g, first+e, &edges[2*e], &edges[2*e+1]);
+  }
+  edges = shuffle_edges(comm, edges, count, n, npes, 1, &my_nedges);
+  nrows = block_range(n, npes, proc_id, &first_row);
+  A = csr_from_edges(nrows, first_row, n, edges, my_nedges);
+  free(edges);
+  outdeg = calloc(n, sizeof(int));
+  csr_col_counts(A, outdeg);
+  MPI_Allreduce(MPI_IN_PLACE, outdeg, n, MPI_INT, MPI_SUM, comm);
+  pr_write_binary(comm, fname, A, n, outdeg, nparts, NULL);
+  *nnz = 0;
+  for(k=0; k<n; k++){
+    *nnz += outdeg[k];
+  }
+  csr_free(A);
+  free(outdeg);
+}
+
+int main(int argc, char **argv){
+  int npes, proc_id;
+  MPI_Init (&argc, &argv);                      /* starts MPI */
+  MPI_Comm_rank (MPI_COMM_WORLD, &proc_id);     /* get current process id */
+  MPI_Comm_size (MPI_COMM_WORLD, &npes);        /* get number of processes */
+
+  if(argc < 4){
+    if(proc_id == 0){
+      printf("usage: %s scale edgefactor graph.txt|graph.bin [-seed s] [-abc a b c] [-parts k]\n  scale: 2^scale pages, at most 30\n  edgefactor: links per page\n  graph.bin: write a binary graph as pr_convert does, any other name is a row/col text file\n  -seed: random seed (default 1), the graph does not depend on the number of processors\n  -abc: quadrant probabilities (default 0.57 0.19 0.19), the fourth is 1-a-b-c\n  -parts: with a binary graph, store a split of the rows for k processors\n",argv[0]);
+    }
+    MPI_Finalize();
+    return 0;
+  }
+
+  rmat_t g = {atoi(argv[1]), 0.57, 0.19, 0.19, 1};
+  long long nedges = (long long) atoi(argv[2]) << g.scale;
+  long long first, count, nnz;
+  size_t len = strlen(argv[3]);
+  int nparts = 0, p;
+  double t0;
+
+  for(p=4; p<argc; p++){//optional flags after the positional args
+    if(strcmp(argv[p],"-seed") == 0 && p+1 < argc){
+      g.seed = strtoull(argv[++p], NULL, 10);
+    }
+    else if(strcmp(argv[p],"-abc") == 0 && p+3 < argc){
+      g.a = atof(argv[++p]);
+      g.b = atof(argv[++p]);
+      g.c = atof(argv[++p]);
+    }
+    else if(strcmp(argv[p],"-parts") == 0 && p+1 < argc){
+      nparts = atoi(argv[++p]);
+    }
+    else{
+      if(proc_id == 0){ printf("unknown option %s\n",argv[p]); }
+      MPI_Finalize();
+      return 0;
+    }
+  }
+  if(g.scale < 1 || g.scale > 30 || nedges < 1 || g.a < 0 || g.b < 0 || g.c < 0 ||
+     g.a + g.b + g.c > 1.0){
+    if(proc_id == 0){ printf("need 1 <= scale <= 30, edgefactor >= 1 and probabilities adding to at most 1\n"); }
+    MPI_Finalize();
+    return 0;
+  }
+
+  int binary = (len >= 4 && strcmp(&argv[3][len-4],".bin") == 0);
+  if(!binary && nedges > INT_MAX){
+    if(proc_id == 0){ printf("text graphs hold at most %d links, write a .bin graph\n",INT_MAX); }
+    MPI_Finalize();
+    return 0;
+  }
+  // shuffle_edges counts each proc's row and column ints in an int
+  if(binary && (nedges + npes - 1) / npes > INT_MAX / 2){
+    if(proc_id == 0){
+      printf("binary graphs hold at most %d links per processor, use at least %lld processors\n",
+             INT_MAX / 2, (nedges + INT_MAX/2 - 1) / (INT_MAX/2));
+    }
+    MPI_Finalize();
+    return 0;
+  }
+
+  // Links split evenly over the procs
+  first = nedges / npes * proc_id + (proc_id < nedges % npes ? proc_id : nedges % npes);
+  count = nedges / npes + (proc_id < nedges % npes ? 1 : 0);
+  t0 = MPI_Wtime();
+  if(binary){
+    write_binary(MPI_COMM_WORLD, argv[3], &g, first, count, nparts, &nnz);
+  }
+  else{
+    write_text(MPI_COMM_WORLD, argv[3], &g, nedges, first, count);
+    nnz = nedges;
+  }
+  if(proc_id == 0){
+    printf("Wrote %s: %d rows, %lld links from %lld drawn in %.2f seconds\n",
+           argv[3],1 << g.scale,nnz,nedges,MPI_Wtime()-t0);
+  }
+
+  MPI_Finalize();
+  return 0;
+}
@@ -0,0 +1,120 @@
+// One copy of the rank vector per node instead of one per processor.
+// The processors on a node share a window holding all n ranks. Each
+// writes its own pages straight into it, and only one leader per node
+// takes part in the exchange between nodes, gathering every node's
+// pages in place. Memory and network traffic then go with the number
+// of nodes rather than processors.
+//
+// The leaders exchange whole nodes' pages at once, so the pages of the
+// processors on a node must be one run. They are when the processors
+// on a node have consecutive ranks, as mpirun places them by default;
+// otherwise pr_shared_open gives up and the ranks are kept per
+// processor.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+#include <pagerank.h>
+
+struct pr_shared {
+  MPI_Comm node;                // the processors on this node
+  MPI_Comm leaders;             // node rank 0 of every node, MPI_COMM_NULL on the rest
+  MPI_Win win[PR_SHARED_VECS];
+  double *vec[PR_SHARED_VECS];  // the shared vectors, all n pages each
+  int *node_counts;             // pages of each node, leaders only
+  int *node_displs;
+};
+
+// Collectively share PR_SHARED_VECS vectors of n doubles between the
+// processors on each node of comm, where proc p holds counts[p] pages
+// from displs[p]. Returns NULL on every proc if some node's pages are
+// not one run.
+pr_shared_t *pr_shared_open(MPI_Comm comm, int n, int *counts, int *displs){
+  pr_shared_t *sh;
+  MPI_Comm node;
+  MPI_Aint size;
+  int proc_id, node_id, nnodes, disp, i, ok;
+  int lo, hi, len, run[2];
+
+  MPI_Comm_rank(comm, &proc_id);
+  MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, proc_id, MPI_INFO_NULL, &node);
+  MPI_Comm_rank(node, &node_id);
+  lo = displs[proc_id];
+  hi = displs[proc_id] + counts[proc_id];
+  len = counts[proc_id];
+  MPI_Allreduce(MPI_IN_PLACE, &lo, 1, MPI_INT, MPI_MIN, node);
+  MPI_Allreduce(MPI_IN_PLACE, &hi, 1, MPI_INT, MPI_MAX, node);
+  MPI_Allreduce(MPI_IN_PLACE, &len, 1, MPI_INT, MPI_SUM, node);
+  ok = (hi - lo == len);
+  MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+  if(!ok){
+    MPI_Comm_free(&node);
+    return NULL;
+  }
+
+  sh = malloc(sizeof(pr_shared_t));
+  sh->node = node;
+  sh->node_counts = NULL;
+  sh->node_displs = NULL;
+  MPI_Comm_split(comm, (node_id == 0) ? 0 : MPI_UNDEFINED, proc_id, &sh->leaders);
+  if(node_id == 0){
+    MPI_Comm_size(sh->leaders, &nnodes);
+    sh->node_counts = malloc(nnodes * sizeof(int));
+    sh->node_displs = malloc(nnodes * sizeof(int));
+    run[0] = len;
+    run[1] = lo;
+    int *runs = malloc(2*nnodes * sizeof(int));
+    MPI_Allgather(run, 2, MPI_INT, runs, 2, MPI_INT, sh->leaders);
+    for(i=0; i<nnodes; i++){
+      sh->node_counts[i] = runs[2*i];
+      sh->node_displs[i] = runs[2*i+1];
+    }
+    free(runs);
+  }
+  // The leader holds the memory, the others find it with a query
+  for(i=0; i<PR_SHARED_VECS; i++){
+    MPI_Win_allocate_shared((node_id == 0) ? (MPI_Aint) n*sizeof(double) : 0, sizeof(double),
+                            MPI_INFO_NULL, node, &sh->vec[i], &sh->win[i]);
+    MPI_Win_shared_query(sh->win[i], 0, &size, &disp, &sh->vec[i]);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, sh->win[i]);
+  }
+  return sh;
+}
+
+// Vector i of the shared ones
+double *pr_shared_vec(pr_shared_t *sh, int i){
+  return sh->vec[i];
+}
+
+// Once every processor has written its own pages of vec, one of the
+// shared vectors, make all n pages of it visible everywhere.
+// Collective over the processors given to pr_shared_open.
+void pr_shared_exchange(pr_shared_t *sh, double *vec){
+  int i;
+  for(i=0; i<PR_SHARED_VECS-1 && sh->vec[i] != vec; i++);
+  MPI_Win_sync(sh->win[i]);
+  MPI_Barrier(sh->node);
+  if(sh->leaders != MPI_COMM_NULL){
+    MPI_Win_sync(sh->win[i]);
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                   sh->vec[i], sh->node_counts, sh->node_displs, MPI_DOUBLE, sh->leaders);
+    MPI_Win_sync(sh->win[i]);
+  }
+  MPI_Barrier(sh->node);
+  MPI_Win_sync(sh->win[i]);
+}
+
+void pr_shared_free(pr_shared_t *sh){
+  int i;
+  for(i=0; i<PR_SHARED_VECS; i++){
+    MPI_Win_unlock_all(sh->win[i]);
+    MPI_Win_free(&sh->win[i]);
+  }
+  if(sh->leaders != MPI_COMM_NULL){
+    MPI_Comm_free(&sh->leaders);
+  }
+  MPI_Comm_free(&sh->node);
+  free(sh->node_counts);
+  free(sh->node_displs);
+  free(sh);
+}
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+# Scaling sweep for mpi_heat. Prints CSV with one line per run and
+# phase, each with the min/avg/max seconds over the processors, e.g.
+#   ./scale-heat.sh > heat-scaling.csv
+
+make mpi_heat >&2
+
+max_time=1000
+procs="1 2 4 8"
+
+# Strong scaling: the same rods on every processor count
+widths="10000 100000 1000000"
+
+# Weak scaling: cells per processor, the rod grows with the processors
+per_proc_widths="100000"
+
+# Extra mpi_heat options for every run, e.g. "-halo 8"
+options=""
+
+# Threads per processor
+export HEAT_NUMTHREADS=${HEAT_NUMTHREADS:-1}
+
+mpirun_opts="--oversubscribe"
+if [[ $EUID -eq 0 ]]; then mpirun_opts="$mpirun_opts --allow-run-as-root"; fi
+
+echo "scaling,procs,threads,max_time,width,phase,min,avg,max"
+
+# run_heat scaling np width
+run_heat() {
+    echo "$1 np $2 width $3" >&2
+    mpirun $mpirun_opts -np $2 ./mpi_heat $max_time $3 0 -timing $options 2>&1 >/dev/null |
+	awk -v pre="$1,$2,$HEAT_NUMTHREADS,$max_time,$3" \
+	    '/^ *phase/ {on=1; next} on && NF==4 {print pre "," $1 "," $2 "," $3 "," $4}'
+}
+
+for w in $widths; do
+    for np in $procs; do
+	run_heat strong $np $w
+    done
+done
+
+for w in $per_proc_widths; do
+    for np in $procs; do
+	run_heat weak $np $((w*np))
+    done
+done
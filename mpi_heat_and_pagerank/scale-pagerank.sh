@@ -0,0 +1,68 @@
+#!/bin/bash
+
+# Scaling sweep for mpi_dense_pagerank on R-MAT graphs from pr_rmat.
+# Prints CSV with one line per run and phase, each with the min/avg/max
+# seconds over the processors, e.g.
+#   ./scale-pagerank.sh > pagerank-scaling.csv
+# The graphs are made once and kept in $graph_dir. 2^scale pages with
+# 16 links each is 10^6 links at scale 16 and 10^9 at scale 26, so set
+# the scales to suit the machine.
+
+make mpi_dense_pagerank pr_rmat >&2
+
+procs="1 2 4 8"
+edgefactor=16
+damping=0.85
+
+# Strong scaling: the same graphs on every processor count
+scales="16 18 20"
+
+# Weak scaling: graph scale on one processor, one more for each
+# doubling of the processors, so the links per processor stay put
+per_proc_scale=16
+
+# Extra mpi_dense_pagerank options for every run, e.g. "-pattern"
+options=""
+
+graph_dir=${GRAPH_DIR:-rmat-graphs}
+
+# Threads per processor
+export PAGERANK_NUMTHREADS=${PAGERANK_NUMTHREADS:-1}
+
+mpirun_opts="--oversubscribe"
+if [[ $EUID -eq 0 ]]; then mpirun_opts="$mpirun_opts --allow-run-as-root"; fi
+
+mkdir -p $graph_dir
+max_np=$(echo $procs | tr ' ' '\n' | sort -n | tail -1)
+
+echo "scaling,procs,threads,scale,links,phase,min,avg,max"
+
+# graph scale, made on the most processors if it is not there yet
+graph() {
+    local g=$graph_dir/rmat-$1-$edgefactor.bin
+    if [[ ! -f $g ]]; then
+	mpirun $mpirun_opts -np $max_np ./pr_rmat $1 $edgefactor $g >&2
+    fi
+    echo $g
+}
+
+# run_pagerank scaling np scale
+run_pagerank() {
+    local g=$(graph $3)
+    echo "$1 np $2 scale $3" >&2
+    mpirun $mpirun_opts -np $2 ./mpi_dense_pagerank $g $damping -top 10 -timing $options 2>&1 >/dev/null |
+	awk -v pre="$1,$2,$PAGERANK_NUMTHREADS,$3,$((edgefactor << $3))" \
+	    '/^ *phase/ {on=1; next} /^Collectives/ {on=0} on && NF==4 {print pre "," $1 "," $2 "," $3 "," $4}'
+}
+
+for s in $scales; do
+    for np in $procs; do
+	run_pagerank strong $np $s
+    done
+done
+
+s=$per_proc_scale
+for np in $procs; do
+    run_pagerank weak $np $s
+    s=$((s+1))
+done